@@ -0,0 +1,113 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "debounce.h"
+
+
+uint8_t debounce_chatter[GENESIS_NUM_PADS][NUM_GEN_BUTTONS];
+
+/** Filter state for one pad */
+struct debounce_state {
+    /** Debounced button state */
+    uint16_t state;
+    
+    /** Vertical counters: a 2-bit count of consecutive samples
+     * disagreeing with the debounced state, one bit of the count per
+     * variable, with each button in its own bit position. This
+     * updates all buttons at once in a handful of instructions. */
+    uint16_t count0, count1;
+};
+
+static struct debounce_state pads[GENESIS_NUM_PADS];
+
+
+/** Records a bounce for every button set in the mask */
+static void count_chatter(uint8_t chatter[], uint16_t bounced)
+{
+    uint8_t button;
+    
+    for (button = GEN_RIGHT; bounced; button++, bounced >>= 1)
+    {
+        if ((bounced & 1) && chatter[button] != 0xFF)
+            chatter[button]++;
+    }
+}
+
+
+uint16_t debounce_filter(uint8_t pad, uint16_t raw)
+{
+#if DEBOUNCE_MODE == DEBOUNCE_OFF
+    (void)pad;
+    return raw;
+#else
+    struct debounce_state *d = &pads[pad];
+    uint16_t state = d->state, count0 = d->count0, count1 = d->count1;
+    uint16_t changing, expired;
+    
+#if DEBOUNCE_MODE == DEBOUNCE_EAGER
+    /* Presses go straight through; only releases are counted */
+    state |= raw;
+    changing = state & ~raw;
+#else
+    changing = state ^ raw;
+#endif
+    
+    /* A button that went back before its count ran out bounced */
+    if ((count0 | count1) & ~changing)
+        count_chatter(debounce_chatter[pad], (count0 | count1) & ~changing);
+    
+    /* Count up where the sample disagrees, reset everywhere else */
+    count1 = (count1 ^ count0) & changing;
+    count0 = ~count0 & changing;
+    
+#if DEBOUNCE_SAMPLES == 1
+    expired = count0 & ~count1;
+#elif DEBOUNCE_SAMPLES == 2
+    expired = ~count0 & count1;
+#else
+    expired = count0 & count1;
+#endif
+    
+    state ^= expired;
+    d->state = state;
+    d->count0 = count0 & ~expired;
+    d->count1 = count1 & ~expired;
+    
+    return state;
+#endif
+}
+
+
+uint16_t debounce_hold(uint8_t pad, uint16_t raw)
+{
+#if DEBOUNCE_MODE == DEBOUNCE_OFF
+    (void)pad;
+    return raw;
+#elif DEBOUNCE_MODE == DEBOUNCE_EAGER
+    return pads[pad].state | raw;
+#else
+    (void)raw;
+    return pads[pad].state;
+#endif
+}
+
+
+void debounce_clear_chatter(uint8_t pad)
+{
+    memset(debounce_chatter[pad], 0, sizeof(debounce_chatter[pad]));
+}
@@ -0,0 +1,71 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef debounce_h__
+#define debounce_h__
+
+#include <stdint.h>
+
+#include "genesis_pad.h"
+
+/** Debounce modes */
+#define DEBOUNCE_OFF        0   /**< Pass button states straight through */
+#define DEBOUNCE_EAGER      1   /**< Presses register on the first sample;
+                                     releases need DEBOUNCE_SAMPLES in a row */
+#define DEBOUNCE_INTEGRATOR 2   /**< Both presses and releases need
+                                     DEBOUNCE_SAMPLES in a row */
+
+#ifndef DEBOUNCE_MODE
+#define DEBOUNCE_MODE DEBOUNCE_EAGER
+#endif
+
+/** Consecutive report scans needed to accept a change (1 to 3). Only
+ * scans for a report count (see debounce_hold()), so a release (and
+ * in the integrator mode, a press) is delayed by this many poll
+ * intervals at most, whether or not the pads are oversampled. */
+#ifndef DEBOUNCE_SAMPLES
+#define DEBOUNCE_SAMPLES 2
+#endif
+
+/** Number of times each button bounced (changed back before the
+ * change was accepted, over report scans), per pad and indexed by
+ * enum genesis_buttons. Saturates at 255; a high count points to a
+ * worn switch or a bad cable. Read by the host through a feature
+ * report page. */
+extern uint8_t debounce_chatter[GENESIS_NUM_PADS][NUM_GEN_BUTTONS];
+
+/** Filter one sample of the Genesis button bits
+ * 
+ * \param pad Which pad (index into genesis_buttons) the sample came from
+ * \param raw Button bits as just read from the pad
+ * \return Debounced button bits
+ */
+uint16_t debounce_filter(uint8_t pad, uint16_t raw);
+
+/** Apply the debounced state to a sample taken between report scans,
+ * without advancing the filter or counting bounces. In the eager
+ * mode presses still show at once, so they can be latched.
+ * 
+ * \param pad Which pad the sample came from
+ * \param raw Button bits as just read from the pad
+ * \return Debounced button bits
+ */
+uint16_t debounce_hold(uint8_t pad, uint16_t raw);
+
+/** Clear one pad's debounce_chatter counts */
+void debounce_clear_chatter(uint8_t pad);
+
+#endif
@@ -0,0 +1,76 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "event_log.h"
+
+#ifdef EVENT_LOG
+#include "genesis_pad.h"
+#include "usb_gamepad.h"
+
+#if EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)
+#error "EVENT_LOG_SIZE must be a power of 2"
+#endif
+#if EVENT_LOG_SIZE > 128
+#error "EVENT_LOG_SIZE must be at most 128"
+#endif
+
+
+uint16_t event_log_dropped = 0;
+
+/** Ring buffer of events, oldest at log_tail */
+static input_event_t event_log[EVENT_LOG_SIZE];
+static uint8_t log_head = 0;
+static uint8_t log_tail = 0;
+
+/** State last recorded for each pad */
+static uint16_t logged_buttons[GENESIS_NUM_PADS];
+
+
+void event_log_record(uint8_t pad, uint16_t buttons, uint16_t time)
+{
+    input_event_t *event;
+    
+    if (buttons == logged_buttons[pad])
+        return;
+    logged_buttons[pad] = buttons;
+    
+    if ((uint8_t)(log_head - log_tail) >= EVENT_LOG_SIZE)
+    {
+        event_log_dropped++;
+        return;
+    }
+    
+    event = &event_log[log_head % EVENT_LOG_SIZE];
+    event->time = time;
+    event->frame = usb_frame_number();
+    event->buttons = buttons | ((uint16_t)pad << EVENT_PAD_SHIFT);
+    log_head++;
+}
+
+
+uint8_t event_log_read(input_event_t *events, uint8_t max)
+{
+    uint8_t n = 0;
+    
+    while (n < max && log_tail != log_head)
+    {
+        events[n++] = event_log[log_tail % EVENT_LOG_SIZE];
+        log_tail++;
+    }
+    return n;
+}
+
+#endif
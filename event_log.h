@@ -0,0 +1,72 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef event_log_h__
+#define event_log_h__
+
+/* Input event log. When built with EVENT_LOG defined (make
+ * EVENT_LOG=1), every change of a pad's button state is recorded in a
+ * ring buffer with its time and USB frame number, and streamed to the
+ * host in batches over a vendor-specific interrupt IN endpoint (see
+ * usb_event_send() and readme.md). Without EVENT_LOG, recording
+ * compiles to nothing. */
+
+#include <stdint.h>
+
+#ifdef EVENT_LOG
+
+/** One change of a pad's button state, sent to the host as is
+ * (little-endian) */
+typedef struct {
+    uint16_t time;      /**< Scheduler timer value when sampled (0.5us ticks) */
+    uint16_t frame;     /**< USB frame number when sampled (11 bits) */
+    uint16_t buttons;   /**< Genesis button bits, pad number on top */
+} input_event_t;
+
+/** Position of the pad number in input_event_t.buttons */
+#define EVENT_PAD_SHIFT 12
+
+/** Events held while waiting for the host. Must be a power of 2, up
+ * to 128. */
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 64
+#endif
+
+/** Events lost because the log was full, since power-up. Wraps. */
+extern uint16_t event_log_dropped;
+
+/** Record a pad's button state if it changed since it was last
+ * recorded
+ * 
+ * \param pad Which pad was sampled
+ * \param buttons Button bits, after debouncing
+ * \param time Scheduler timer value when the pad was sampled
+ */
+void event_log_record(uint8_t pad, uint16_t buttons, uint16_t time);
+
+/** Take the oldest events out of the log
+ * 
+ * \param events Where to copy the events
+ * \param max Most events to take
+ * \return Number of events taken
+ */
+uint8_t event_log_read(input_event_t *events, uint8_t max);
+
+#else
+#define event_log_record(pad, buttons, time)
+#endif
+
+#endif
@@ -18,72 +18,376 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <avr/io.h>
-#include <util/delay.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "usb_gamepad.h"
 #include "genesis_pad.h"
+#include "scan_sched.h"
+#include "settings.h"
+#include "probe.h"
+#include "debounce.h"
+#include "turbo.h"
+#include "perf.h"
+#include "latch.h"
+#include "event_log.h"
+#include "playback.h"
 
 #include <stdbool.h>
 
 
 #define CPU_PRESCALE(n) (CLKPR = 0x80, CLKPR = (n))
 
+#if GAMEPAD_PLAYERS != GENESIS_NUM_PADS
+#error "Each pad needs its own gamepad player"
+#endif
+
+
+/** HID report buttons for each combination of the A, B, C and Start
+ * bits (bits 4-7), and of the X, Y, Z and Mode bits (bits 8-11), of
+ * the Genesis buttons. Built from the active remap profile by
+ * build_report_tables(), so remapping costs nothing per scan. */
+static uint16_t report_abcs[16];
+static uint16_t report_xyzm[16];
+
+/** Debounced button bits of each pad, from the last scan */
+static uint16_t pad_buttons[GENESIS_NUM_PADS];
+
+/** Axis value for a pair of opposing directions. The first
+ * direction wins if both are somehow pressed. */
+#define AXIS(neg, pos) ((neg) ? 0 : ((pos) ? 255 : 127))
+
+#define AXES(n) { \
+    AXIS((n) & GEN_BIT(GEN_LEFT), (n) & GEN_BIT(GEN_RIGHT)), \
+    AXIS((n) & GEN_BIT(GEN_UP), (n) & GEN_BIT(GEN_DOWN)) }
+
+/** X/Y axis values for each combination of direction bits */
+static const uint8_t PROGMEM report_axes[16][2] = {
+    AXES(0),  AXES(1),  AXES(2),  AXES(3),
+    AXES(4),  AXES(5),  AXES(6),  AXES(7),
+    AXES(8),  AXES(9),  AXES(10), AXES(11),
+    AXES(12), AXES(13), AXES(14), AXES(15)
+};
+
+
+/** Report bit for a remapped HID button number, or 0 for none */
+static inline uint16_t remap_bit(uint8_t hid)
+{
+    return hid ? GAMEPAD_BUTTON(hid) : 0;
+}
+
+
+/** Build the report button tables from the active remap profile */
+static void build_report_tables(void)
+{
+    const uint8_t *map = settings.remap[settings.profile];
+    uint8_t n, b;
+    
+    for (n = 0; n < 16; n++)
+    {
+        report_abcs[n] = 0;
+        report_xyzm[n] = 0;
+        for (b = 0; b < 4; b++)
+        {
+            if (n & (1 << b))
+            {
+                report_abcs[n] |= remap_bit(map[b]);
+                report_xyzm[n] |= remap_bit(map[b + 4]);
+            }
+        }
+    }
+}
+
 
 /** Update the USB HID Gamepad pressed/release status based on 
- * Genesis button states */
-void update_usb_gamepad_state(void)
+ * Genesis button states
+ * 
+ * \param player Player (gamepad report) to update
+ * \param buttons Genesis button bits to report
+ */
+void update_usb_gamepad_state(uint8_t player, uint16_t buttons)
 {
-    gamepad_state.button1 = genesis_button_states[GEN_A];
-    gamepad_state.button2 = genesis_button_states[GEN_B];
-    gamepad_state.button3 = genesis_button_states[GEN_C];
-    gamepad_state.button4 = genesis_button_states[GEN_X];
-    gamepad_state.button5 = genesis_button_states[GEN_Y];
-    gamepad_state.button6 = genesis_button_states[GEN_Z];
-    
-    gamepad_state.button_Select = genesis_button_states[GEN_MODE];
-    gamepad_state.button_Start = genesis_button_states[GEN_START];
-    
-    if (genesis_button_states[GEN_LEFT])
-        gamepad_state.xAxis = 0;
-    else if (genesis_button_states[GEN_RIGHT])
-        gamepad_state.xAxis = 255;
-    else
-        gamepad_state.xAxis = 127;
+    uint8_t dirs = buttons & GEN_DIRECTION_BITS;
+    gamepad_state_t *state = &gamepad_state[player];
+    
+    state->xAxis = pgm_read_byte(&report_axes[dirs][0]);
+    state->yAxis = pgm_read_byte(&report_axes[dirs][1]);
+    state->buttons = report_abcs[(buttons >> 4) & 0x0F]
+        | report_xyzm[(buttons >> 8) & 0x0F];
+#ifdef GENESIS_XE1AP
+    state->zAxis = 0;
+#endif
+}
+
 
-    if (genesis_button_states[GEN_UP])
-        gamepad_state.yAxis = 0;
-    else if (genesis_button_states[GEN_DOWN])
-        gamepad_state.yAxis = 255;
+#ifdef GENESIS_ANALOG
+/** Report an analog controller's axes in full, in place of the
+ * directions update_usb_gamepad_state() was given
+ * 
+ * \param player Player (gamepad report) to update
+ */
+static void update_usb_analog_state(uint8_t player)
+{
+    gamepad_state_t *state = &gamepad_state[player];
+    
+    /* Only the first port can have an analog controller */
+    switch (genesis_pad_type[player])
+    {
+#ifdef GENESIS_XE1AP
+    case GEN_TYPE_XE1AP:
+        state->zAxis = genesis_axes[GEN_AXIS_THROTTLE];
+        break;
+#endif
+#ifdef GENESIS_SMS_ANALOG
+    case GEN_TYPE_PADDLE:
+    case GEN_TYPE_SPORTS_PAD:
+        break;
+#endif
+    default:
+        return;
+    }
+    state->xAxis = genesis_axes[GEN_AXIS_X];
+    state->yAxis = genesis_axes[GEN_AXIS_Y];
+}
+#endif
+
+
+/** Read and debounce all pads into pad_buttons, keeping the
+ * performance counters and the event log, and pass on any mouse
+ * motion. Any press ends playback.
+ * 
+ * \param report Whether the scan is for a report, rather than an
+ *        oversample; only those advance the debouncing
+ * \return Timer value once the pads have been read
+ */
+static uint16_t scan_pads(bool report)
+{
+    uint8_t pad;
+    uint16_t start, end;
+    
+    probe_begin(PROBE_SCAN);
+    start = sched_now();
+    genesis_load();
+    end = sched_now();
+    probe_end(PROBE_SCAN);
+    perf_scan(end - start);
+    usb_mouse_move(genesis_mouse_dx, genesis_mouse_dy, genesis_mouse_buttons);
+    
+    for (pad = 0; pad < GENESIS_NUM_PADS; pad++)
+    {
+        if (report)
+            pad_buttons[pad] = debounce_filter(pad, genesis_buttons[pad]);
+        else
+            pad_buttons[pad] = debounce_hold(pad, genesis_buttons[pad]);
+        event_log_record(pad, pad_buttons[pad], end);
+    }
+#ifdef PLAYBACK
+    playback_check_override(pad_buttons);
+#endif
+    return end;
+}
+
+
+/** Sample the pads between reports, so presses too short to be
+ * caught by a report scan are latched into the next report */
+static void oversample_pads(void)
+{
+    uint8_t pad;
+    
+    scan_pads(false);
+    for (pad = 0; pad < GENESIS_NUM_PADS; pad++)
+    {
+        latch_sample(pad, pad_buttons[pad]);
+    }
+}
+
+
+/** Apply any setting changes requested by holding buttons while
+ * the converter is plugged in:
+ * 
+ *  - START + A: 1 ms (1000 Hz) polling
+ *  - START + B: standard polling interval
+ *  - START + C: next button remapping profile
+ *  - START + Up: generic USB gamepad
+ *  - START + Left: PS3 arcade stick
+ *  - START + Right: keyboard
+ *  - START + Up + Right: XInput pad (not on the AT90USB162)
+ *  - START + Down: next press latching policy
+ * 
+ * A poll rate and a personality can be picked together. Only the
+ * first pad port is checked. Changes are saved, so they persist
+ * until changed again. */
+static void apply_boot_options(void)
+{
+    uint16_t buttons;
+    bool changed = true;
+    
+    genesis_load();
+    buttons = genesis_buttons[0];
+    
+    if (!(buttons & GEN_BIT(GEN_START)))
+        return;
+    
+    if (buttons & GEN_BIT(GEN_A))
+        settings.poll_interval = GAMEPAD_INTERVAL_FAST;
+    else if (buttons & GEN_BIT(GEN_B))
+        settings.poll_interval = GAMEPAD_INTERVAL;
+    else if (buttons & GEN_BIT(GEN_C))
+        settings.profile = (settings.profile + 1) % REMAP_PROFILES;
+    else
+        changed = false;
+    
+#ifdef USB_XINPUT
+    if ((buttons & GEN_BIT(GEN_UP)) && (buttons & GEN_BIT(GEN_RIGHT)))
+        settings.personality = USB_PERSONALITY_XINPUT;
     else
-        gamepad_state.yAxis = 127;
+#endif
+    if (buttons & GEN_BIT(GEN_UP))
+        settings.personality = USB_PERSONALITY_GAMEPAD;
+    else if (buttons & GEN_BIT(GEN_LEFT))
+        settings.personality = USB_PERSONALITY_PS3;
+    else if (buttons & GEN_BIT(GEN_RIGHT))
+        settings.personality = USB_PERSONALITY_KEYBOARD;
+    else if (buttons & GEN_BIT(GEN_DOWN))
+        settings.latch = (settings.latch + 1) % NUM_LATCH_MODES;
+    else if (!changed)
+        return;
     
-    usb_gamepad_send();
+    settings_save();
+}
+
+
+/** Time to wait after a suspend before a remote wakeup, so the bus
+ * has been idle for the 5ms the host expects (3ms had passed when the
+ * suspend was detected) */
+#define WAKEUP_HOLDOFF_TICKS SCHED_US(2000)
+
+
+/** Sleep in power-down mode while the host has the bus suspended,
+ * until it resumes the bus or a pad press wakes it up */
+static void suspend_sleep(void)
+{
+    uint16_t start = sched_now();
+    
+    while (usb_suspended
+        && (uint16_t)(sched_now() - start) < WAKEUP_HOLDOFF_TICKS)
+    {
+        /* No scans run while suspended, so the scan schedule is
+         * stale and mustn't cut the sleep short */
+        sched_idle_until(start + WAKEUP_HOLDOFF_TICKS);
+    }
+    
+    genesis_wake_arm();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    while (usb_suspended && !genesis_woken)
+    {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        cli();
+    }
+    sei();
+    genesis_wake_disarm();
+    
+    /* If the host doesn't allow this, it stays suspended and we go
+     * straight back to sleep */
+    if (genesis_woken)
+        usb_remote_wakeup();
 }
 
 
 /** Main program loop */
 int main(void)
 {
+    uint8_t pad;
+    uint16_t last_sample = 0;
+    
     // set for 16 MHz clock
     CPU_PRESCALE(0);
     
+    probe_init();
+    sched_init();
     genesis_init();
+    
+    settings_load();
+    apply_boot_options();
+    usb_gamepad_interval = settings.poll_interval;
+    usb_personality = settings.personality;
+    build_report_tables();
+    usb_gamepad_reset_state();
 
-    // Initialize the USB, and then wait for the host to set configuration.
-    // If the Teensy is powered without a PC connected to the USB port,
-    // this will wait forever.
+    /* Scanning starts straight away rather than waiting for the
+     * host to configure the converter. Reports gathered meanwhile
+     * are kept, so the first poll already sees any held buttons. */
     usb_init();
-    while (!usb_configured()) {}
-
-    // Wait an extra second for the PC's operating system to load drivers
-    // and do whatever it does to actually be ready for input
-    _delay_ms(1000);
 
+    /* Scans are phase-locked to the host's polls, so each report
+     * is sampled as late as possible before it is collected. While
+     * waiting, the pads are sampled at OVERSAMPLE_HZ if latching. */
     while (1)
     {
-        usb_gamepad_reset_state();
-        genesis_load();
-        update_usb_gamepad_state();
-        _delay_ms(3);
+        if (usb_suspended)
+        {
+            suspend_sleep();
+            continue;
+        }
+        
+        /* The CPU idles between samples, woken by the timer or USB */
+        while (!sched_scan_ready())
+        {
+            usb_event_send();
+            usb_playback_receive();
+            if (settings.latch == LATCH_OFF)
+            {
+                sched_idle(sched_now() + SCHED_FRAME_TICKS);
+                continue;
+            }
+            if ((uint16_t)(sched_now() - last_sample) >= OVERSAMPLE_TICKS)
+            {
+                last_sample = sched_now();
+                oversample_pads();
+            }
+            sched_idle(last_sample + OVERSAMPLE_TICKS);
+        }
+        gamepad_sample_time = scan_pads(true);
+        last_sample = gamepad_sample_time;
+        turbo_update();
+        for (pad = 0; pad < GENESIS_NUM_PADS; pad++)
+        {
+#ifdef PLAYBACK
+            if (playback_active)
+            {
+                update_usb_gamepad_state(pad, playback_buttons[pad]);
+                continue;
+            }
+#endif
+            /* Latched presses are dropped once a report holding
+             * them has been handed to the host */
+            if (!usb_gamepad_pending(pad))
+                latch_clear(pad);
+            update_usb_gamepad_state(pad,
+                turbo_filter(pad, latch_filter(pad, pad_buttons[pad])));
+#ifdef GENESIS_ANALOG
+            update_usb_analog_state(pad);
+#endif
+        }
+        usb_gamepad_send();
+        sched_scan_done();
+        
+        /* A pad plugged in since power-up is measured straight after
+         * a scan, well clear of the next one */
+        genesis_calibrate_next();
+        
+        if (usb_settings_changed)
+        {
+            /* Saving can take a while if much has changed, but only
+             * happens when the host reprograms the mapping */
+            usb_settings_changed = 0;
+            build_report_tables();
+            settings_save();
+        }
     }
 }
 
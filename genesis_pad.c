@@ -14,50 +14,155 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <avr/io.h>
 #include <util/delay.h>
+#include <util/atomic.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 
 #include "genesis_pad.h"
+#include "pad_hal.h"
+#include "scan_sched.h"
+#include "perf.h"
 
 
-/** Map of PortB pins to Genesis buttons when mux is high */
-static const enum genesis_buttons mux1_map[8] =
-{
-    [0] = GEN_RIGHT,
-    [1] = GEN_LEFT,
-    [2] = GEN_DOWN,
-    [3] = GEN_UP,
-    [4] = GEN_C,
-    [6] = GEN_B
-};
+/* Wiring of pad port pins to Genesis buttons, for each mux phase.
+ * Alternate wiring only needs changes here; the decode tables
+ * below are generated from these at compile time. */
 
-/** Map of PortB pins to Genesis buttons when mux is low */
-static const enum genesis_buttons mux0_map[8] =
-{
-    [4] = GEN_START,
-    [6] = GEN_A
-};
+/** Pad port pins to Genesis buttons when mux is high */
+#define MUX1_PIN0 GEN_RIGHT
+#define MUX1_PIN1 GEN_LEFT
+#define MUX1_PIN2 GEN_DOWN
+#define MUX1_PIN3 GEN_UP
+#define MUX1_PIN4 GEN_C
+#define MUX1_PIN5 GEN_UNASSIGNED
+#define MUX1_PIN6 GEN_B
+#define MUX1_PIN7 GEN_UNASSIGNED
 
-/** Map of PortB pins to Genesis buttons when the extra
- * buttons for the 6-button pad are reported. */
-static const enum genesis_buttons sixbutton_map[8] =
-{
-    [0] = GEN_MODE,
-    [1] = GEN_X,
-    [2] = GEN_Y,
-    [3] = GEN_Z
+/** Pad port pins to Genesis buttons when mux is low */
+#define MUX0_PIN0 GEN_UNASSIGNED
+#define MUX0_PIN1 GEN_UNASSIGNED
+#define MUX0_PIN2 GEN_UNASSIGNED
+#define MUX0_PIN3 GEN_UNASSIGNED
+#define MUX0_PIN4 GEN_START
+#define MUX0_PIN5 GEN_UNASSIGNED
+#define MUX0_PIN6 GEN_A
+#define MUX0_PIN7 GEN_UNASSIGNED
+
+/** Pad port pins to Genesis buttons when the extra buttons for
+ * the 6-button pad are reported. */
+#define SIX_PIN0 GEN_MODE
+#define SIX_PIN1 GEN_X
+#define SIX_PIN2 GEN_Y
+#define SIX_PIN3 GEN_Z
+#define SIX_PIN4 GEN_UNASSIGNED
+#define SIX_PIN5 GEN_UNASSIGNED
+#define SIX_PIN6 GEN_UNASSIGNED
+#define SIX_PIN7 GEN_UNASSIGNED
+
+/** Pad port pins to Genesis buttons in the second nibble a Team
+ * Player sends for each pad (the first matches the mux high wiring,
+ * the third the 6-button wiring) */
+#define TAP_PIN0 GEN_START
+#define TAP_PIN1 GEN_A
+#define TAP_PIN2 GEN_C
+#define TAP_PIN3 GEN_B
+#define TAP_PIN4 GEN_UNASSIGNED
+#define TAP_PIN5 GEN_UNASSIGNED
+#define TAP_PIN6 GEN_UNASSIGNED
+#define TAP_PIN7 GEN_UNASSIGNED
+
+/** Pad port pins to Genesis buttons in the first two nibbles an
+ * XE-1AP sends (pins 0-3 for the first, 4-7 for the second). Its A'
+ * and B' buttons are reported as A and B, and D, E1, E2 and Select as
+ * X, Y, Z and Mode. */
+#define XE1AP_PIN0 GEN_A
+#define XE1AP_PIN1 GEN_B
+#define XE1AP_PIN2 GEN_C
+#define XE1AP_PIN3 GEN_X
+#define XE1AP_PIN4 GEN_Y
+#define XE1AP_PIN5 GEN_Z
+#define XE1AP_PIN6 GEN_START
+#define XE1AP_PIN7 GEN_MODE
+
+
+/** Button bits for one nibble value, given the buttons on its 4 pins */
+#define NIBBLE_BITS(n, b0, b1, b2, b3) \
+    (((n) & 1 ? GEN_BIT(b0) : 0) | ((n) & 2 ? GEN_BIT(b1) : 0) | \
+     ((n) & 4 ? GEN_BIT(b2) : 0) | ((n) & 8 ? GEN_BIT(b3) : 0))
+
+/** Table of button bits for all 16 values of a nibble */
+#define NIBBLE_TABLE(b0, b1, b2, b3) { \
+    NIBBLE_BITS(0, b0, b1, b2, b3),  NIBBLE_BITS(1, b0, b1, b2, b3),  \
+    NIBBLE_BITS(2, b0, b1, b2, b3),  NIBBLE_BITS(3, b0, b1, b2, b3),  \
+    NIBBLE_BITS(4, b0, b1, b2, b3),  NIBBLE_BITS(5, b0, b1, b2, b3),  \
+    NIBBLE_BITS(6, b0, b1, b2, b3),  NIBBLE_BITS(7, b0, b1, b2, b3),  \
+    NIBBLE_BITS(8, b0, b1, b2, b3),  NIBBLE_BITS(9, b0, b1, b2, b3),  \
+    NIBBLE_BITS(10, b0, b1, b2, b3), NIBBLE_BITS(11, b0, b1, b2, b3), \
+    NIBBLE_BITS(12, b0, b1, b2, b3), NIBBLE_BITS(13, b0, b1, b2, b3), \
+    NIBBLE_BITS(14, b0, b1, b2, b3), NIBBLE_BITS(15, b0, b1, b2, b3)  }
+
+/** Decode tables for one mux phase, indexed by the low and high
+ * nibbles of the (inverted) port value */
+struct phase_map {
+    uint16_t lo[16];
+    uint16_t hi[16];
 };
 
+#define PHASE_MAP(P) { \
+    NIBBLE_TABLE(P##_PIN0, P##_PIN1, P##_PIN2, P##_PIN3), \
+    NIBBLE_TABLE(P##_PIN4, P##_PIN5, P##_PIN6, P##_PIN7) }
+
+static const struct phase_map PROGMEM mux1_map = PHASE_MAP(MUX1);
+static const struct phase_map PROGMEM mux0_map = PHASE_MAP(MUX0);
+static const struct phase_map PROGMEM sixbutton_map = PHASE_MAP(SIX);
+#ifdef GENESIS_TEAM_PLAYER
+static const struct phase_map PROGMEM tap_map = PHASE_MAP(TAP);
+#endif
+#ifdef GENESIS_XE1AP
+static const struct phase_map PROGMEM xe1ap_map = PHASE_MAP(XE1AP);
+#endif
+
+
+/** Current pressed state of each Sega Genesis button, one bit each */
+uint16_t genesis_buttons[GENESIS_NUM_PADS] = { 0 };
 
-/** Current pressed/release state of each Sega Genesis button */
-bool genesis_button_states[NUM_GEN_BUTTONS] = { false };
+/** Which gamepad type is connected for each pad */
+enum genesis_type genesis_pad_type[GENESIS_NUM_PADS];
 
-/** Which gamepad type is connected */
-enum genesis_type genesis_pad_type = GEN_TYPE_1_2_BUTTON;
+bool genesis_multitap = false;
 
+#ifdef GENESIS_ANALOG
+uint8_t genesis_axes[NUM_GEN_AXES];
+#endif
+
+#ifdef GENESIS_XE1AP
+/** Analog channel carrying each XE-1AP axis, in genesis_axis order */
+static const uint8_t xe1ap_channels[NUM_GEN_AXES] = { 1, 0, 2 };
+#endif
+
+#ifdef GENESIS_MEGA_MOUSE
+int16_t genesis_mouse_dx = 0;
+int16_t genesis_mouse_dy = 0;
+uint8_t genesis_mouse_buttons = 0;
+#endif
+
+volatile bool genesis_woken = false;
+
+/** Time allowed for the pad lines to settle after a mux change */
+uint8_t genesis_settle_us = GENESIS_SETTLE_MAX_US;
+
+/** genesis_settle_us converted to _delay_loop_2 iterations */
+static uint16_t settle_loops = GENESIS_SETTLE_MAX_US * (F_CPU / 4000000UL);
+
+/** Settle time needed by each port's pad, in microseconds, or 0 while
+ * nothing there responds to the mux */
+static uint8_t port_settle[GENESIS_NUM_PORTS];
+
+/** Ports with a newly plugged in pad still to be measured, one bit
+ * each */
+static uint8_t calibrate_ports = 0;
 
-/** Which Pin in Port B is used for mux control */
-#define MUX_PIN 5
 
 /** Mask to detect a 3-button Genesis pad */
 #define LEFT_RIGHT_MASK 0x03
@@ -65,96 +170,1410 @@ enum genesis_type genesis_pad_type = GEN_TYPE_1_2_BUTTON;
 /** Mask to detect a 6-button Genesis pad */
 #define ALL_DIRECTION_MASK 0x0F
 
-static inline void mux_high(void)
+/** Buttons a 3 or 6-button pad reports with select low */
+#define MUX0_BUTTONS (GEN_BIT(GEN_A) | GEN_BIT(GEN_START))
+
+/** Number of back-to-back port reads taken after each calibration edge */
+#define CAL_SAMPLES 64
+
+/** Number of select pulses to measure during calibration */
+#define CAL_PULSES 4
+
+/** GENESIS_SIX_TIMEOUT_US in timer ticks */
+#define SIX_TIMEOUT_TICKS SCHED_US(GENESIS_SIX_TIMEOUT_US)
+
+/** Loop over each pad read directly with the select line */
+#define FOR_EACH_DIRECT(p) for (p = 0; p < GENESIS_DIRECT_PADS; p++)
+
+/** Loop over each physical pad port */
+#define FOR_EACH_PORT(p) for (p = 0; p < GENESIS_NUM_PORTS; p++)
+
+/** Pad port a direct pad is read through */
+#ifdef GENESIS_EA_4WAY
+#define PAD_PORT(p) 0
+#else
+#define PAD_PORT(p) (p)
+#endif
+
+/** Select mask of the pad port a direct pad is read through */
+#define PAD_BIT(p) PAD_PORT_BIT(PAD_PORT(p))
+
+/** Longest wait for a Team Player or Mega Mouse to acknowledge a
+ * nibble */
+#define ACK_TIMEOUT_TICKS SCHED_US(100)
+
+/** Team Player pad type IDs, as read on the pad port pins (the data
+ * lines arrive in reverse order, so D0 is pin 3) */
+#define TAP_ID_3_BUTTON 0x0
+#define TAP_ID_6_BUTTON 0x8
+#define TAP_ID_MOUSE    0x4
+#define TAP_ID_NONE     0xF
+
+/** Nibbles sent by a Team Player for each type of pad */
+#define TAP_NIBBLES_3_BUTTON 2
+#define TAP_NIBBLES_6_BUTTON 3
+#define TAP_NIBBLES_MOUSE 6
+
+/** Pad used for Team Player player n (0 to 3). Player A takes the
+ * first port's pad, and the rest follow the direct pads. */
+#define TAP_PAD(n) ((n) ? GENESIS_DIRECT_PADS + (n) - 1 : 0)
+
+/** Mega Mouse ID, as read on the pad port pins (inverted) with select
+ * low: just pin 1 grounded. With select high, all four data lines
+ * are grounded, which no pad can do. */
+#define MOUSE_ID 0x02
+
+/** Nibbles clocked out of a Mega Mouse after its ID: two that read as
+ * all ones, then the sign and overflow flags, the buttons, and the
+ * high and low nibbles of X and then Y */
+#define MOUSE_NIBBLES 8
+
+/** Bits of the Mega Mouse flags nibble */
+#define MOUSE_X_SIGN 0x01
+#define MOUSE_Y_SIGN 0x02
+#define MOUSE_X_OVER 0x04
+#define MOUSE_Y_OVER 0x08
+
+/** Nibbles an XE-1AP sends once select falls: two of buttons, the
+ * high nibbles of its four analog channels, then their low nibbles,
+ * its A, B, A' and B' buttons on their own, and a nibble of all ones */
+#define XE1AP_NIBBLES 12
+
+/** Nibble holding the high nibble of analog channel 0. Each channel's
+ * low nibble follows 4 nibbles later. */
+#define XE1AP_CHANNEL_NIBBLE 2
+
+/** XE1AP timeouts in timer ticks */
+#define XE1AP_START_TICKS SCHED_US(GENESIS_XE1AP_START_US)
+#define XE1AP_TIMEOUT_TICKS SCHED_US(GENESIS_XE1AP_TIMEOUT_US)
+
+/** Scans between looks for an XE-1AP while the first port is empty.
+ * Each look holds interrupts off for up to GENESIS_XE1AP_START_US. */
+#define XE1AP_PROBE_SCANS 64
+
+/** Paddle timeouts in timer ticks */
+#define PADDLE_START_TICKS SCHED_US(GENESIS_PADDLE_START_US)
+#define PADDLE_TIMEOUT_TICKS SCHED_US(GENESIS_PADDLE_TIMEOUT_US)
+
+/** Longest time between the last sample of a paddle's low half and
+ * the first of its high half, well under one half period, so no
+ * half can have been missed between them */
+#define PADDLE_GAP_TICKS SCHED_US(20)
+
+/** Shortest low half taken from a paddle, around a third of its half
+ * period. A bouncing button on TR toggles far faster than that. */
+#define PADDLE_HALF_TICKS SCHED_US(20)
+
+/** Good paddle reads in a row before the first port is taken to hold
+ * a paddle. Until then it is read as whatever else it passes for. */
+#define PADDLE_CONFIRM 8
+
+/** Scans between looks for a paddle while the first port is empty or
+ * holds a 1/2 button pad. Each look takes up to
+ * GENESIS_PADDLE_START_US. */
+#define PADDLE_PROBE_SCANS 64
+
+/** Failed paddle reads in a row before it is taken as unplugged.
+ * Until then, the last position and button are kept. */
+#define PADDLE_MISSES 4
+
+/** GENESIS_SPORTS_PAD_RESET_US in timer ticks */
+#define SPORTS_RESET_TICKS SCHED_US(GENESIS_SPORTS_PAD_RESET_US)
+
+/** Sports Pad transfers in a row with every line high before it is
+ * taken as unplugged. A connected pad only sends that while rolling
+ * left and up by a single count each time. */
+#define SPORTS_LOST_READS 4
+
+/** Stick positions beyond which an analog controller also reports
+ * directions */
+#define STICK_DIR_LOW 64
+#define STICK_DIR_HIGH 192
+
+
+/** Rising select edges on each port since a 6-button pad's counter
+ * there last reset. The pad reports its extra buttons after the
+ * third, so this tells us what the pad is currently presenting on
+ * each select level. */
+static uint8_t six_phase[GENESIS_NUM_PORTS];
+
+/** Timer value at the most recent select edge on each port */
+static uint16_t last_edge_time[GENESIS_NUM_PORTS];
+
+/** Set for a port when its pad type needs a full detection
+ * handshake, which can only be done once the 6-button counter
+ * has timed out */
+static bool probe_pending[GENESIS_DIRECT_PADS];
+
+#ifdef GENESIS_EA_4WAY
+/** Set when calibration found a 4-Way Play on the ports */
+static bool four_way_present = false;
+#endif
+
+#ifdef GENESIS_XE1AP
+/** Scans left before the next look for an XE-1AP */
+static uint8_t xe1ap_probe_wait = 0;
+#endif
+
+#ifdef GENESIS_SMS_ANALOG
+/** Paddle reads that have failed in a row */
+static uint8_t paddle_misses = 0;
+
+/** Good paddle reads in a row, while not yet taken as a paddle */
+static uint8_t paddle_seen = 0;
+
+/** Scans left before the next look for a paddle. Starts half way,
+ * so it stays out of step with the XE-1AP's. */
+static uint8_t paddle_probe_wait = PADDLE_PROBE_SCANS / 2;
+
+/** Sports Pad transfers in a row that read as nothing connected */
+static uint8_t sports_lost = 0;
+#endif
+
+
+static inline void mux_settle(void)
+{
+    _delay_loop_2(settle_loops);
+}
+
+/** Raises select on some ports, counting the edge on each
+ * 
+ * \param ports Ports to drive, one PAD_PORT_BIT() each
+ */
+static inline void mux_high(uint8_t ports)
+{
+    uint16_t now;
+    uint8_t port;
+    
+    pad_select_high(ports);
+    now = sched_now();
+    FOR_EACH_PORT(port)
+    {
+        if (ports & PAD_PORT_BIT(port))
+        {
+            last_edge_time[port] = now;
+            six_phase[port]++;
+        }
+    }
+    mux_settle();
+}
+
+/** Lowers select on some ports
+ * 
+ * \param ports Ports to drive, one PAD_PORT_BIT() each
+ */
+static inline void mux_low(uint8_t ports)
+{
+    uint16_t now;
+    uint8_t port;
+    
+    pad_select_low(ports);
+    now = sched_now();
+    FOR_EACH_PORT(port)
+    {
+        if (ports & PAD_PORT_BIT(port))
+            last_edge_time[port] = now;
+    }
+    mux_settle();
+}
+
+static inline bool is_genesis_pad(enum genesis_type type)
+{
+    return type == GEN_TYPE_3_BUTTON || type == GEN_TYPE_6_BUTTON;
+}
+
+/** Whether a pad type changes its data lines with select, and so
+ * needs them to settle afterwards */
+static inline bool follows_mux(enum genesis_type type)
+{
+    return is_genesis_pad(type) || type == GEN_TYPE_MOUSE
+        || type == GEN_TYPE_SPORTS_PAD;
+}
+
+/** Whether a direct pad's type decides the select timing. While a
+ * multitap is attached, the first port's pad is one of its players,
+ * which the multitap reads for us. */
+static inline bool is_direct_pad(uint8_t pad)
+{
+    return pad != 0 || !genesis_multitap;
+}
+
+/** Reads every directly attached pad, inverted so pressed (grounded)
+ * lines read as 1
+ * 
+ * \param pressed Array of GENESIS_DIRECT_PADS values to fill in
+ */
+static void read_direct(uint8_t pressed[])
+{
+#ifdef GENESIS_EA_4WAY
+    uint8_t p;
+    
+    if (!four_way_present)
+    {
+        /* Just a pad on the first port; the other players read as
+         * disconnected */
+        pressed[0] = ~pad_read(0);
+        for (p = 1; p < GENESIS_DIRECT_PADS; p++)
+            pressed[p] = 0;
+        return;
+    }
+    
+    FOR_EACH_DIRECT(p)
+    {
+        pad_4way_select(p);
+        pressed[p] = ~pad_read(0);
+    }
+#else
+    pad_read_pressed(pressed);
+#endif
+}
+
+
+/** Drives the mux lines to the given level and measures how long
+ * one port's data lines take to settle afterwards.
+ * 
+ * \param port Pad port to watch
+ * \param high Level to drive the mux lines to
+ * \param changed Set to true if any data line changed in response
+ * \return Settle time in microseconds, or 0xFF if the lines were
+ *         still changing at the end of the sample window
+ */
+static uint8_t measure_edge(uint8_t port, bool high, bool *changed)
+{
+    uint8_t samples[CAL_SAMPLES], before, i, last = 0;
+    uint16_t start, elapsed, ticks;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        before = pad_read(port);
+        start = sched_now();
+        if (high)
+            pad_select_high(PAD_PORT_BIT(port));
+        else
+            pad_select_low(PAD_PORT_BIT(port));
+        
+        for (i = 0; i < CAL_SAMPLES; i++)
+            samples[i] = pad_read(port);
+        
+        elapsed = sched_now() - start;
+    }
+    
+    if ((samples[0] ^ before) & PAD_DATA_MASK)
+        *changed = true;
+    
+    for (i = 1; i < CAL_SAMPLES; i++)
+    {
+        if ((samples[i] ^ samples[i - 1]) & PAD_DATA_MASK)
+        {
+            *changed = true;
+            last = i;
+        }
+    }
+    
+    if (last == CAL_SAMPLES - 1)
+        return 0xFF;
+    
+    /* Round up to the end of the first stable sample */
+    ticks = (uint16_t)(last + 1) * elapsed / CAL_SAMPLES;
+    return (ticks + SCHED_TICKS_PER_US - 1) / SCHED_TICKS_PER_US;
+}
+
+
+/** Measures how quickly one port's pad responds to the mux line,
+ * setting port_settle to suit. Only that port is pulsed, and a
+ * 6-button pad there is left to time out again before its next full
+ * read.
+ * 
+ * \param port Pad port to measure
+ */
+static void calibrate_port(uint8_t port)
 {
-    PORTB |= (1<<5);
-    _delay_us(100);
+    uint8_t i, settle, worst = 0;
+    bool changed = false;
+    
+#ifdef GENESIS_EA_4WAY
+    pad_select_high(PAD_PORT_BIT(port));
+    _delay_us(GENESIS_SETTLE_MAX_US);
+    four_way_present = pad_4way_detect();
+    pad_select_low(PAD_PORT_BIT(port));
+#endif
+    
+    for (i = 0; i < CAL_PULSES; i++)
+    {
+        settle = measure_edge(port, true, &changed);
+        if (settle > worst)
+            worst = settle;
+        
+        settle = measure_edge(port, false, &changed);
+        if (settle > worst)
+            worst = settle;
+    }
+    last_edge_time[port] = sched_now();
+    six_phase[port] += CAL_PULSES;
+    
+    if (!changed)
+        port_settle[port] = 0;
+    else if (worst > (GENESIS_SETTLE_MAX_US - GENESIS_SETTLE_MARGIN_US) / 2)
+        port_settle[port] = GENESIS_SETTLE_MAX_US;
+    else
+        port_settle[port] = worst * 2 + GENESIS_SETTLE_MARGIN_US;
+}
+
+
+/** Decodes a pad port snapshot into Genesis button bits
+ * 
+ * \param pressed Pad port value, inverted so pressed buttons read as 1
+ * \param map Decode tables for the mux phase it was taken in
+ */
+static inline uint16_t decode_phase(uint8_t pressed,
+    const struct phase_map *map)
+{
+    return pgm_read_word(&map->lo[pressed & 0x0F])
+        | pgm_read_word(&map->hi[pressed >> 4]);
 }
 
-static inline void mux_low(void)
+
+/** Decodes a 1/2 button 8-bit computer stick or SMS pad, which
+ * ignores the select line. Re-orders the buttons so the primary
+ * 8-bit computer button is A, and the optional other button is B.
+ * (B and C directly follow A in the button bits.) */
+static inline uint16_t decode_two_button(uint8_t pressed)
 {
-    PORTB &= ~(1<<5);
-    _delay_us(100);
+    uint16_t buttons = decode_phase(pressed, &mux1_map);
+    
+    return (buttons & GEN_DIRECTION_BITS)
+        | ((buttons & (GEN_BIT(GEN_B) | GEN_BIT(GEN_C))) >> 1);
 }
 
 
-/** Loads the current button states from Port B according to 
- * the provided map
+/** Refreshes what can be read without any select edges on some
+ * ports, while a 6-button pad's counter is still running there. Their
+ * select lines were left low after the third rising edge, where 3 and
+ * 6-button pads still report A and Start. 1/2 button pads (behind an
+ * EA 4-Way Play, along with one) don't use select at all.
  * 
- * \param mux_map Array mapping pin positions to Genesis buttons
+ * \param ports Ports to refresh, one PAD_PORT_BIT() each
  */
-static void load_buttons(const enum genesis_buttons mux_map[])
+static void refresh_without_edges(uint8_t ports)
 {
-    uint8_t portvals, i;
-    enum genesis_buttons button;
+    uint8_t pressed[GENESIS_DIRECT_PADS], p;
+    
+    read_direct(pressed);
+    
+    FOR_EACH_DIRECT(p)
+    {
+        if (!is_direct_pad(p) || !(ports & PAD_BIT(p)))
+            continue;
         
-    portvals = PINB;
+        if (genesis_pad_type[p] == GEN_TYPE_1_2_BUTTON)
+        {
+            genesis_buttons[p] = decode_two_button(pressed[p]);
+        }
+        else if (is_genesis_pad(genesis_pad_type[p])
+            && six_phase[PAD_PORT(p)] == 3)
+        {
+            genesis_buttons[p] = (genesis_buttons[p] & ~MUX0_BUTTONS)
+                | decode_phase(pressed[p], &mux0_map);
+        }
+    }
+}
+
+
+/** Use the longest settle time any port's pad needs. With nothing
+ * responding to the mux, stay conservative, so a pad plugged in
+ * later is still detected reliably. */
+static void choose_settle(void)
+{
+    uint8_t p, settle = 0;
+    
+    FOR_EACH_PORT(p)
+    {
+        if (port_settle[p] > settle)
+            settle = port_settle[p];
+    }
+    if (settle == 0)
+        settle = GENESIS_SETTLE_MAX_US;
+    
+    genesis_settle_us = settle;
+    settle_loops = settle * (F_CPU / 4000000UL);
+    perf_settle(settle);
+}
+
+
+/** Pick a settle time to suit newly detected pad types. A Genesis pad
+ * or mouse that was just plugged in gets the longest settle time until
+ * genesis_calibrate_next() has measured it. */
+static void pad_types_changed(const enum genesis_type last_type[])
+{
+    uint8_t in_use = 0, p, port;
+    
+    FOR_EACH_DIRECT(p)
+    {
+        if (!is_direct_pad(p) || !follows_mux(genesis_pad_type[p]))
+            continue;
+        port = PAD_PORT(p);
+        in_use |= 1 << port;
+        if (!follows_mux(last_type[p]) && port_settle[port] == 0)
+        {
+            port_settle[port] = GENESIS_SETTLE_MAX_US;
+            calibrate_ports |= 1 << port;
+        }
+    }
     
-    for (i = 0; i < 8; i++)
+    /* Ports where nothing responds to the mux any more no longer
+     * count */
+    FOR_EACH_PORT(port)
     {
-        button = mux_map[i];
+        if (!(in_use & (1 << port)))
+            port_settle[port] = 0;
+    }
+    calibrate_ports &= in_use;
+    choose_settle();
+}
+
+
+#if defined(GENESIS_TEAM_PLAYER) || defined(GENESIS_MEGA_MOUSE)
+/** Clocks one nibble out of a Team Player or Mega Mouse on the first
+ * port by setting TR, then waiting for it to acknowledge by matching
+ * it on TL. The wait is a tight loop on the port, so each nibble is
+ * taken the moment it is acknowledged.
+ * 
+ * \param tr Level to set TR to
+ * \return Data lines as read on the pad port pins (not inverted),
+ *         or 0xFF if no acknowledgement arrived in time
+ */
+static uint8_t handshake_nibble(bool tr)
+{
+    uint16_t start = sched_now();
+    uint8_t value;
+    
+    if (tr)
+        pad_tr_high();
+    else
+        pad_tr_low();
+    
+    do
+    {
+        value = pad_read(0);
+        if (!(value & (1 << PAD_TL_PIN)) != tr)
+            return value & 0x0F;
+    } while ((uint16_t)(sched_now() - start) < ACK_TIMEOUT_TICKS);
+    
+    return 0xFF;
+}
+#endif
+
+
+#if defined(GENESIS_MEGA_MOUSE) || defined(GENESIS_ANALOG)
+/** Puts a nibble read on the pad port pins back in data line order
+ * (pin 0 carries D3, and pin 3 carries D0) */
+static inline uint8_t data_nibble(uint8_t pins)
+{
+    return ((pins & 0x01) << 3) | ((pins & 0x02) << 1)
+        | ((pins & 0x04) >> 1) | ((pins & 0x08) >> 3);
+}
+#endif
+
+
+#ifdef GENESIS_ANALOG
+/** Directions for the stick position in genesis_axes, for reports
+ * that only have a dpad. Past a quarter of the travel either side of
+ * the centre counts as pressed. */
+static uint16_t stick_directions(void)
+{
+    uint16_t buttons = 0;
+    
+    if (genesis_axes[GEN_AXIS_X] < STICK_DIR_LOW)
+        buttons |= GEN_BIT(GEN_LEFT);
+    else if (genesis_axes[GEN_AXIS_X] >= STICK_DIR_HIGH)
+        buttons |= GEN_BIT(GEN_RIGHT);
+    if (genesis_axes[GEN_AXIS_Y] < STICK_DIR_LOW)
+        buttons |= GEN_BIT(GEN_UP);
+    else if (genesis_axes[GEN_AXIS_Y] >= STICK_DIR_HIGH)
+        buttons |= GEN_BIT(GEN_DOWN);
+    return buttons;
+}
+#endif
+
+
+#ifdef GENESIS_TEAM_PLAYER
+/** Checks the first pulse's snapshots for a Team Player, which
+ * reads as Left and Right grounded with select high, and nothing
+ * grounded with select low: the reverse of any real pad. */
+static inline bool is_team_player(uint8_t mux1, uint8_t mux0)
+{
+    return (mux1 & PAD_DATA_MASK) == LEFT_RIGHT_MASK
+        && !(mux0 & PAD_DATA_MASK);
+}
+
+
+/** Runs the Team Player handshake, with select already low, and
+ * loads the multitap's pads. Each nibble is clocked by toggling TR;
+ * the first two are always zero, then come the four pad type IDs,
+ * then the data nibbles of each pad in turn.
+ * 
+ * \return true if the whole handshake completed
+ */
+static bool read_team_player(void)
+{
+    static const struct phase_map *const maps[TAP_NIBBLES_6_BUTTON] =
+        { &mux1_map, &tap_map, &sixbutton_map };
+    uint8_t ids[4], i, n, nibbles, value;
+    enum genesis_type type;
+    uint16_t buttons;
+    bool tr = false, ok = false;
+    
+    for (i = 0; i < 2; i++, tr = !tr)
+    {
+        if (handshake_nibble(tr) != 0)
+            goto done;
+    }
+    
+    for (i = 0; i < 4; i++, tr = !tr)
+        ids[i] = handshake_nibble(tr);
+    
+    for (i = 0; i < 4; i++)
+    {
+        switch (ids[i])
+        {
+        case TAP_ID_3_BUTTON:
+            type = GEN_TYPE_3_BUTTON;
+            nibbles = TAP_NIBBLES_3_BUTTON;
+            break;
+        case TAP_ID_6_BUTTON:
+            type = GEN_TYPE_6_BUTTON;
+            nibbles = TAP_NIBBLES_6_BUTTON;
+            break;
+        case TAP_ID_MOUSE:
+            /* Not supported; skip over its data */
+            type = GEN_TYPE_NONE;
+            nibbles = TAP_NIBBLES_MOUSE;
+            break;
+        case TAP_ID_NONE:
+            type = GEN_TYPE_NONE;
+            nibbles = 0;
+            break;
+        default:
+            goto done;
+        }
         
-        if (button != GEN_UNASSIGNED)
+        buttons = 0;
+        for (n = 0; n < nibbles; n++, tr = !tr)
         {
-            genesis_button_states[button] = (portvals & (1 << i)) == 0 ? true : false;
+            value = handshake_nibble(tr);
+            if (value == 0xFF)
+                goto done;
+            if (type != GEN_TYPE_NONE)
+                buttons |= decode_phase(~value & 0x0F, maps[n]);
         }
+        
+        genesis_buttons[TAP_PAD(i)] = buttons;
+        genesis_pad_type[TAP_PAD(i)] = type;
     }
+    ok = true;
+    
+done:
+    pad_tr_high();
+    return ok;
 }
 
 
-/* Public methods follow */
+/** Forget a Team Player that was unplugged or stopped responding,
+ * releasing the pads after the direct ones. The first port's pad is
+ * left to the caller. */
+static void team_player_lost(void)
+{
+    uint8_t i;
+    
+    genesis_multitap = false;
+    probe_pending[0] = true;
+    for (i = 1; i < 4; i++)
+    {
+        genesis_buttons[TAP_PAD(i)] = 0;
+        genesis_pad_type[TAP_PAD(i)] = GEN_TYPE_NONE;
+    }
+}
+#endif
 
-void genesis_init(void)
+
+#ifdef GENESIS_MEGA_MOUSE
+/** Checks the first pulse's snapshots for a Mega Mouse */
+static inline bool is_mega_mouse(uint8_t mux1, uint8_t mux0)
 {
-    DDRB = 0x00 | (1 << 5);
-    PORTB = 0xFF;
+    return (mux1 & ALL_DIRECTION_MASK) == ALL_DIRECTION_MASK
+        && (mux0 & ALL_DIRECTION_MASK) == MOUSE_ID;
 }
 
 
-void genesis_load(void)
+/** Signed motion along one Mega Mouse axis. Motion that overflowed
+ * is taken as the most the mouse can report.
+ * 
+ * \param value Magnitude, as the low 8 bits of a 9-bit count
+ * \param sign Sign bit of the count
+ * \param over Set if the count overflowed
+ */
+static inline int16_t mouse_axis(uint8_t value, bool sign, bool over)
+{
+    if (over)
+        return sign ? -256 : 255;
+    return sign ? (int16_t)value - 256 : value;
+}
+
+
+/** Runs the Mega Mouse handshake, with select already low, and loads
+ * its motion and buttons. Each nibble is clocked by toggling TR, as
+ * for a Team Player; the mouse reports the motion since it was last
+ * read, so motion between scans is never lost.
+ * 
+ * \return true if the whole handshake completed
+ */
+static bool read_mega_mouse(void)
+{
+    uint8_t data[MOUSE_NIBBLES], i, flags;
+    bool tr = false;
+    
+    for (i = 0; i < MOUSE_NIBBLES; i++, tr = !tr)
+    {
+        data[i] = handshake_nibble(tr);
+        if (data[i] == 0xFF)
+        {
+            pad_tr_high();
+            return false;
+        }
+        data[i] = data_nibble(data[i]);
+    }
+    
+    /* The last nibble left TR high, ready for the next read */
+    if (data[0] != 0x0F || data[1] != 0x0F)
+        return false;
+    
+    flags = data[2];
+    genesis_mouse_buttons = data[3];
+    genesis_mouse_dx = mouse_axis((data[4] << 4) | data[5],
+        flags & MOUSE_X_SIGN, flags & MOUSE_X_OVER);
+    /* The mouse counts Y upwards */
+    genesis_mouse_dy = -mouse_axis((data[6] << 4) | data[7],
+        flags & MOUSE_Y_SIGN, flags & MOUSE_Y_OVER);
+    return true;
+}
+#endif
+
+
+#ifdef GENESIS_XE1AP
+/** Whether to look for an XE-1AP on the first port this scan: only
+ * while nothing else is there, and then once every XE1AP_PROBE_SCANS
+ * scans */
+static inline bool xe1ap_probe_due(void)
 {
-    mux_high();
-    load_buttons(mux1_map);
-    mux_low();
+    if (genesis_pad_type[0] != GEN_TYPE_NONE)
+        return false;
+    if (xe1ap_probe_wait)
+    {
+        xe1ap_probe_wait--;
+        return false;
+    }
+    xe1ap_probe_wait = XE1AP_PROBE_SCANS - 1;
+    return true;
+}
+
 
-    if ((PINB & LEFT_RIGHT_MASK) == 0)
+/** Collects the nibbles an XE-1AP sends once select has fallen. It
+ * paces the transfer itself, holding TL low while each nibble is
+ * valid, so this is a tight loop on the port. Call with interrupts
+ * disabled, straight after select falls.
+ * 
+ * \param data Array of XE1AP_NIBBLES port values to fill in
+ * \return Number of nibbles collected before timing out
+ */
+static uint8_t xe1ap_transfer(uint8_t data[])
+{
+    uint16_t start = sched_now(), limit = XE1AP_START_TICKS;
+    uint8_t i, value;
+    
+    /* TL only falls once the XE-1AP has answered; low already means
+     * a button held on some other pad */
+    if (!(pad_read(0) & (1 << PAD_TL_PIN)))
+        return 0;
+    
+    for (i = 0; i < XE1AP_NIBBLES; i++)
     {
-        /* Confirmed 3-button pad */
-        load_buttons(mux0_map);
+        while ((value = pad_read(0)) & (1 << PAD_TL_PIN))
+        {
+            if ((uint16_t)(sched_now() - start) >= limit)
+                return i;
+        }
+        data[i] = value;
+        limit = XE1AP_TIMEOUT_TICKS;
+        if (i == XE1AP_NIBBLES - 1)
+            break;
         
-        /* Detection sequence for 6-button pad now... 
-         * Also see https://segaretro.org/Six_Button_Control_Pad_(Mega_Drive) */
-        mux_high();
-        mux_low();
+        while (!(pad_read(0) & (1 << PAD_TL_PIN)))
+        {
+            if ((uint16_t)(sched_now() - start) >= limit)
+                return i;
+        }
+    }
+    return XE1AP_NIBBLES;
+}
+
+
+/** Drives select low and reads an XE-1AP on the first port, loading
+ * its buttons and axes. Interrupts are disabled for the transfer, as
+ * each nibble is only held for a few microseconds; it is timed to
+ * stay clear of the USB start-of-frame, so the scan scheduling isn't
+ * thrown off. Select is left low, but the other ports are left for
+ * mux_low() to lower and settle.
+ * 
+ * \return true if a whole, consistent transfer was read
+ */
+static bool read_xe1ap(void)
+{
+    uint8_t data[XE1AP_NIBBLES], n, i, c;
+    uint16_t buttons;
+    
+    sched_clear_of_sof(XE1AP_TIMEOUT_TICKS);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pad_select_low(PAD_PORT_BIT(0));
+        n = xe1ap_transfer(data);
+    }
+    last_edge_time[0] = sched_now();
+    
+    /* TR alternates with each nibble, and the last is all ones */
+    if (n != XE1AP_NIBBLES
+        || (data[XE1AP_NIBBLES - 1] & 0x0F) != 0x0F)
+    {
+        return false;
+    }
+    for (i = 1; i < XE1AP_NIBBLES; i++)
+    {
+        if (!((data[i] ^ data[i - 1]) & (1 << PAD_TR_PIN)))
+            return false;
+    }
+    
+    for (i = 0; i < NUM_GEN_AXES; i++)
+    {
+        c = XE1AP_CHANNEL_NIBBLE + xe1ap_channels[i];
+        genesis_axes[i] = (data_nibble(data[c] & 0x0F) << 4)
+            | data_nibble(data[c + 4] & 0x0F);
+    }
+    
+    /* Buttons are active low, like a pad's */
+    buttons = decode_phase(~((data[1] << 4) | (data[0] & 0x0F)),
+        &xe1ap_map);
+    
+    genesis_buttons[0] = buttons | stick_directions();
+    genesis_pad_type[0] = GEN_TYPE_XE1AP;
+    return true;
+}
+
+
+/** Drives select low on the first port and only checks whether an
+ * XE-1AP starts sending, without reading the transfer: that is left
+ * for read_xe1ap() from the next scan, once the type is known. So an
+ * empty port only costs GENESIS_XE1AP_START_US with interrupts off.
+ * Select is left low, as with read_xe1ap().
+ * 
+ * \return true if an XE-1AP answered
+ */
+static bool probe_xe1ap(void)
+{
+    uint16_t start;
+    bool answered = false;
+    
+    sched_clear_of_sof(XE1AP_START_TICKS);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        /* As in xe1ap_transfer(), TL must be high to begin with */
+        answered = pad_read(0) & (1 << PAD_TL_PIN);
+        pad_select_low(PAD_PORT_BIT(0));
+        start = sched_now();
+        while (answered && (pad_read(0) & (1 << PAD_TL_PIN)))
+        {
+            if ((uint16_t)(sched_now() - start) >= XE1AP_START_TICKS)
+                answered = false;
+        }
+    }
+    last_edge_time[0] = sched_now();
+    
+    if (!answered)
+        return false;
+    /* Its lines are mid-transfer, so there is nothing to decode yet */
+    genesis_buttons[0] = 0;
+    genesis_pad_type[0] = GEN_TYPE_XE1AP;
+    return true;
+}
+#endif
+
+
+#ifdef GENESIS_SMS_ANALOG
+/** Whether to look for a paddle on the first port this scan: every
+ * scan while one is connected or one is being confirmed, and once
+ * every PADDLE_PROBE_SCANS scans while the port reads as empty or as
+ * a 1/2 button pad, which is what a paddle otherwise passes for */
+static inline bool paddle_probe_due(void)
+{
+    enum genesis_type type = genesis_pad_type[0];
+    
+    if (genesis_multitap)
+        return false;
+    if (type == GEN_TYPE_PADDLE || paddle_seen)
+        return true;
+    if (type != GEN_TYPE_NONE && type != GEN_TYPE_1_2_BUTTON)
+        return false;
+    if (paddle_probe_wait)
+    {
+        paddle_probe_wait--;
+        return false;
+    }
+    paddle_probe_wait = PADDLE_PROBE_SCANS - 1;
+    return true;
+}
+
+
+/** Looks for a paddle on the first port, and loads its button and
+ * position. It ignores select, and instead toggles TR by itself,
+ * sending the low nibble of its position while TR is low and the
+ * high nibble while it is high. One position is taken from the end
+ * of a low half and the start of the high half that follows; the two
+ * samples must be close enough together that no half can have passed
+ * between them (while an interrupt ran, say), so the nibbles always
+ * belong to the same position. The low half must also have lasted at
+ * least PADDLE_HALF_TICKS, which a bouncing button on TR doesn't.
+ * Each sample is only taken once the port reads the same twice
+ * running, as the data lines may trail TR. Interrupts stay enabled
+ * throughout.
+ * 
+ * \param position Filled in with the paddle's position
+ * \param buttons Filled in with its button, as GEN_BIT(GEN_A)
+ * \return true if a paddle was read
+ */
+static bool read_paddle(uint8_t *position, uint16_t *buttons)
+{
+    uint16_t start = sched_now(), limit = PADDLE_START_TICKS;
+    uint16_t now, low_start = 0, low_time = 0;
+    uint8_t value, last = pad_read(0), low = 0;
+    bool seen_high = false, have_low = false;
+    
+    do
+    {
+        value = pad_read(0);
+        now = sched_now();
+        if (value != last)
+        {
+            /* Anything that doesn't toggle TR has given up by now */
+            if ((value ^ last) & (1 << PAD_TR_PIN))
+                limit = PADDLE_TIMEOUT_TICKS;
+            last = value;
+            continue;
+        }
         
-        /* Technically there should be one more cycle here. However,
-         * my testing with the oscilloscope showed the "all zero"
-         * sequence appeared one cycle earlier than expected. */
+        if (!(value & (1 << PAD_TR_PIN)))
+        {
+            /* Only a low half that was seen to start will do */
+            if (seen_high)
+            {
+                if (!have_low)
+                    low_start = now;
+                low = value;
+                low_time = now;
+                have_low = true;
+            }
+        }
+        else if (have_low && (uint16_t)(now - low_time) < PADDLE_GAP_TICKS
+            && (uint16_t)(low_time - low_start) >= PADDLE_HALF_TICKS)
+        {
+            *position = (data_nibble(value & 0x0F) << 4)
+                | data_nibble(low & 0x0F);
+            /* Its button is on TL, like a 1/2 button pad's first */
+            *buttons = decode_two_button(~value) & GEN_BIT(GEN_A);
+            return true;
+        }
+        else
+        {
+            seen_high = true;
+            have_low = false;
+        }
+    } while ((uint16_t)(now - start) < limit);
+    
+    return false;
+}
+
+
+/** Checks the first pulse's snapshots for a Sports Pad. Its first
+ * two nibbles are the X motion since it was last read, which is zero
+ * at rest, grounding all four data lines with select high and low:
+ * no pad does that, and the Mega Mouse only with select high. Once
+ * detected, it sends anything. */
+static inline bool is_sports_pad(uint8_t mux1, uint8_t mux0)
+{
+    if (genesis_pad_type[0] == GEN_TYPE_SPORTS_PAD)
+        return true;
+    return (mux1 & ALL_DIRECTION_MASK) == ALL_DIRECTION_MASK
+        && (mux0 & ALL_DIRECTION_MASK) == ALL_DIRECTION_MASK;
+}
+
+
+/** Moves a Sports Pad axis position by some motion, stopping at
+ * either end
+ * 
+ * \param pos Position, from 0 to 255
+ * \param hi Inverted snapshot holding the motion's high nibble
+ * \param lo Inverted snapshot holding its low nibble
+ */
+static uint8_t sports_axis(uint8_t pos, uint8_t hi, uint8_t lo)
+{
+    int16_t moved = pos + (int8_t)((data_nibble(~hi & 0x0F) << 4)
+        | data_nibble(~lo & 0x0F));
+    
+    if (moved < 0)
+        return 0;
+    if (moved > 255)
+        return 255;
+    return moved;
+}
+
+
+/** Loads a Sports Pad's buttons and position from the snapshots of
+ * a transfer. It counts select edges since it was last left alone
+ * for GENESIS_SPORTS_PAD_RESET_US, and sends the high and low
+ * nibbles of its X motion and then of its Y motion on the first four,
+ * all latched together when the transfer starts. Its buttons are on
+ * TL and TR throughout, like a 1/2 button pad's.
+ * 
+ * \param n Inverted snapshots taken after each of the four edges
+ */
+static void read_sports_pad(const uint8_t n[4])
+{
+    if (!(n[0] & PAD_DATA_MASK) && !(n[1] & PAD_DATA_MASK)
+        && !(n[2] & PAD_DATA_MASK) && !(n[3] & PAD_DATA_MASK))
+    {
+        /* Every line high: unplugged, or a small move up and left */
+        if (++sports_lost >= SPORTS_LOST_READS)
+        {
+            genesis_buttons[0] = 0;
+            genesis_pad_type[0] = GEN_TYPE_NONE;
+            probe_pending[0] = true;
+        }
+        return;
+    }
+    sports_lost = 0;
+    
+    if (genesis_pad_type[0] != GEN_TYPE_SPORTS_PAD)
+    {
+        genesis_axes[GEN_AXIS_X] = 128;
+        genesis_axes[GEN_AXIS_Y] = 128;
+        genesis_axes[GEN_AXIS_THROTTLE] = 0;
+        genesis_pad_type[0] = GEN_TYPE_SPORTS_PAD;
+    }
+    genesis_axes[GEN_AXIS_X] = sports_axis(genesis_axes[GEN_AXIS_X],
+        n[0], n[1]);
+    genesis_axes[GEN_AXIS_Y] = sports_axis(genesis_axes[GEN_AXIS_Y],
+        n[2], n[3]);
+    /* Rolling the ball would hold directions for good, so it has
+     * none; only the buttons are reported as such */
+    genesis_buttons[0] = decode_two_button(n[0])
+        & (GEN_BIT(GEN_A) | GEN_BIT(GEN_B));
+}
+#endif
+
+
+/* Public methods follow */
+
+void genesis_init(void)
+{
+    uint8_t p;
+    
+    for (p = 0; p < GENESIS_NUM_PADS; p++)
+        genesis_pad_type[p] = GEN_TYPE_NONE;
+    FOR_EACH_DIRECT(p)
+        probe_pending[p] = true;
+    
+    pad_port_init();
+    
+    genesis_calibrate();
+}
+
+
+void genesis_calibrate(void)
+{
+    uint8_t p;
+    
+    FOR_EACH_PORT(p)
+        calibrate_port(p);
+    calibrate_ports = 0;
+    choose_settle();
+    
+    /* Let a 6-button pad's select counter time out again, since
+     * the calibration pulses will have advanced it */
+    _delay_us(GENESIS_SIX_TIMEOUT_US);
+    FOR_EACH_PORT(p)
+        six_phase[p] = 0;
+    FOR_EACH_DIRECT(p)
+        probe_pending[p] = true;
+}
+
+
+void genesis_calibrate_next(void)
+{
+    uint8_t p;
+    
+    FOR_EACH_PORT(p)
+    {
+        if (calibrate_ports & (1 << p))
+        {
+            calibrate_ports &= ~(1 << p);
+            calibrate_port(p);
+            choose_settle();
+            return;
+        }
+    }
+}
+
+
+void genesis_wake_arm(void)
+{
+    mux_high(PAD_ALL_PORTS);
+    /* Let the lines settle first, so that doesn't count as a change */
+    _delay_us(GENESIS_SETTLE_MAX_US);
+    genesis_woken = false;
+    pad_wake_enable();
+}
+
+
+void genesis_wake_disarm(void)
+{
+    pad_wake_disable();
+    mux_low(PAD_ALL_PORTS);
+}
+
+
+ISR(PCINT0_vect)
+{
+    genesis_woken = true;
+}
+
+
+void genesis_load(void)
+{
+    enum genesis_type last_type[GENESIS_DIRECT_PADS];
+    uint8_t mux1[GENESIS_DIRECT_PADS], mux0[GENESIS_DIRECT_PADS];
+    uint8_t detect[GENESIS_DIRECT_PADS], six[GENESIS_DIRECT_PADS];
+    bool needs_six[GENESIS_DIRECT_PADS];
+    bool changed = false;
+#ifdef GENESIS_TEAM_PLAYER
+    bool tap = false;
+#endif
+#ifdef GENESIS_MEGA_MOUSE
+    bool mouse = false;
+#endif
+#ifdef GENESIS_XE1AP
+    bool xe1ap = false;
+#endif
+#ifdef GENESIS_SMS_ANALOG
+    uint8_t sports_y[GENESIS_DIRECT_PADS], nibbles[4];
+    bool paddle = false, sports = false, sports_fresh;
+    uint8_t second, position;
+    uint16_t paddle_buttons;
+#endif
+    uint8_t held = 0, active, probe = 0, p;
+    uint16_t now;
+    
+#ifdef GENESIS_MEGA_MOUSE
+    genesis_mouse_dx = 0;
+    genesis_mouse_dy = 0;
+#endif
+    
+#ifdef GENESIS_SMS_ANALOG
+    /* A paddle ignores select, so it is read whatever the select
+     * lines are doing */
+    if (paddle_probe_due())
+    {
+        paddle = read_paddle(&position, &paddle_buttons);
+        if (genesis_pad_type[0] != GEN_TYPE_PADDLE)
+        {
+            /* A one-off read may just be TR bouncing; only a paddle
+             * keeps it up scan after scan */
+            if (!paddle)
+                paddle_seen = 0;
+            else if (++paddle_seen < PADDLE_CONFIRM)
+                paddle = false;
+        }
+        if (paddle)
+        {
+            paddle_misses = 0;
+            paddle_seen = 0;
+            genesis_axes[GEN_AXIS_X] = position;
+            genesis_axes[GEN_AXIS_Y] = 128;
+            genesis_axes[GEN_AXIS_THROTTLE] = 0;
+            genesis_buttons[0] = paddle_buttons | stick_directions();
+            genesis_pad_type[0] = GEN_TYPE_PADDLE;
+        }
+        else if (genesis_pad_type[0] == GEN_TYPE_PADDLE
+            && ++paddle_misses >= PADDLE_MISSES)
+        {
+            genesis_buttons[0] = 0;
+            genesis_pad_type[0] = GEN_TYPE_NONE;
+            probe_pending[0] = true;
+        }
+        else
+        {
+            /* Missed this time; keep what it last sent */
+            paddle = genesis_pad_type[0] == GEN_TYPE_PADDLE;
+        }
+    }
+#endif
+    
+    now = sched_now();
+    FOR_EACH_PORT(p)
+    {
+        if ((uint16_t)(now - last_edge_time[p]) >= SIX_TIMEOUT_TICKS)
+            six_phase[p] = 0;
+    }
+    
+    FOR_EACH_DIRECT(p)
+    {
+        last_type[p] = genesis_pad_type[p];
+        if (!is_direct_pad(p) || six_phase[PAD_PORT(p)] == 0)
+            continue;
+        if (genesis_pad_type[p] == GEN_TYPE_6_BUTTON
+            || (genesis_pad_type[p] == GEN_TYPE_3_BUTTON && probe_pending[p]))
+        {
+            /* Too soon after the last handshake: any more select
+             * edges would land part way through a 6-button pad's
+             * count and read the wrong buttons (or spoil a pending
+             * detection) */
+            held |= PAD_BIT(p);
+        }
+    }
+    
+#ifdef GENESIS_SMS_ANALOG
+    /* Likewise, a Sports Pad only starts a transfer afresh once it
+     * has been left alone for a while */
+    sports_fresh = (uint16_t)(now - last_edge_time[0]) >= SPORTS_RESET_TICKS;
+    if (genesis_pad_type[0] == GEN_TYPE_SPORTS_PAD && !sports_fresh)
+        held |= PAD_PORT_BIT(0);
+#endif
+    
+    /* Held ports keep their select lines still; the rest are read in
+     * full with edges of their own */
+    if (held)
+        refresh_without_edges(held);
+    active = PAD_ALL_PORTS & ~held;
+    if (!active)
+        return;
+    
+    /* First rising edge. Every pad type starts the same way.
+     * Snapshots are inverted as taken, so pressed buttons and
+     * grounded detection lines all read as 1 */
+    mux_high(active);
+    read_direct(mux1);
+#ifdef GENESIS_XE1AP
+    /* An XE-1AP starts sending the moment select falls. Once one has
+     * answered a probe, it is read in full every scan. */
+    if ((active & PAD_PORT_BIT(0)) && !genesis_multitap)
+    {
+        if (genesis_pad_type[0] == GEN_TYPE_XE1AP)
+            xe1ap = read_xe1ap();
+        else if (xe1ap_probe_due())
+            xe1ap = probe_xe1ap();
+    }
+#endif
+    mux_low(active);
+    read_direct(mux0);
+    
+    FOR_EACH_DIRECT(p)
+    {
+        needs_six[p] = false;
+        if (!(active & PAD_BIT(p)))
+            continue;
         
-        if ((PINB & ALL_DIRECTION_MASK) == 0)
+#ifdef GENESIS_SMS_ANALOG
+        if (p == 0 && paddle)
+            continue;
+        if (p == 0 && sports_fresh && !genesis_multitap
+            && is_sports_pad(mux1[0], mux0[0]))
         {
-            /* Confirmed 6-button pad */
-            genesis_pad_type = GEN_TYPE_6_BUTTON;
-            
-            mux_high();
-            load_buttons(sixbutton_map);
-            mux_low();
+            /* Checked first, as its motion can pass for anything
+             * else. Its Y motion comes with the next select pulse. */
+            sports = true;
+            continue;
+        }
+#endif
+#ifdef GENESIS_XE1AP
+        if (p == 0 && xe1ap)
+            continue;
+        if (p == 0 && last_type[0] == GEN_TYPE_XE1AP)
+        {
+            /* Unplugged, or the transfer went wrong; its lines may
+             * still be mid-transfer, so look again next time rather
+             * than decoding them */
+            genesis_buttons[0] = 0;
+            genesis_pad_type[0] = GEN_TYPE_NONE;
+            continue;
+        }
+#endif
+#ifdef GENESIS_TEAM_PLAYER
+        if (p == 0 && is_team_player(mux1[0], mux0[0]))
+        {
+            /* Read once the other pads have been decoded, while
+             * select is still low */
+            tap = true;
+            continue;
+        }
+#endif
+#ifdef GENESIS_MEGA_MOUSE
+        if (p == 0 && is_mega_mouse(mux1[0], mux0[0]))
+        {
+            /* Also read once the other pads have been decoded */
+            mouse = true;
+            continue;
+        }
+#endif
+        if (!(mux1[p] & PAD_DATA_MASK) && !(mux0[p] & PAD_DATA_MASK))
+        {
+            /* All lines high: nothing is plugged in, or a 1/2 button
+             * pad has nothing pressed. Report neutral either way, and
+             * work out what it is again once something changes. */
+            genesis_buttons[p] = 0;
+            genesis_pad_type[p] = GEN_TYPE_NONE;
+            probe_pending[p] = true;
+        }
+        else if ((mux0[p] & LEFT_RIGHT_MASK) != LEFT_RIGHT_MASK)
+        {
+            genesis_buttons[p] = decode_two_button(mux1[p]);
+            genesis_pad_type[p] = GEN_TYPE_1_2_BUTTON;
         }
         else
         {
-            genesis_pad_type = GEN_TYPE_3_BUTTON;
+            /* Left and Right grounded with select low: a Genesis pad */
+            genesis_buttons[p] = decode_phase(mux1[p], &mux1_map)
+                | decode_phase(mux0[p], &mux0_map);
+            
+            if (genesis_pad_type[p] != GEN_TYPE_3_BUTTON || probe_pending[p])
+                needs_six[p] = true;
+        }
+    }
+    
+#ifdef GENESIS_TEAM_PLAYER
+    if (tap)
+    {
+        genesis_multitap = read_team_player();
+        if (!genesis_multitap)
+        {
+            team_player_lost();
+            genesis_buttons[0] = 0;
+            genesis_pad_type[0] = GEN_TYPE_NONE;
         }
     }
+    else if (genesis_multitap)
+    {
+        /* The first port holds a plain pad again */
+        team_player_lost();
+    }
+#endif
+    
+#ifdef GENESIS_MEGA_MOUSE
+    if (!mouse)
+    {
+        genesis_mouse_buttons = 0;
+    }
+    else if (read_mega_mouse())
+    {
+        /* The mouse has no pad buttons of its own */
+        genesis_buttons[0] = 0;
+        genesis_pad_type[0] = GEN_TYPE_MOUSE;
+    }
     else
     {
-        /* 1/2 button 8-bit computer stick or SMS pad. 
-         * Re-order the buttons so the primary 8-bit computer
-         * button is A, and the optional other button is B */
-        genesis_button_states[GEN_A] = genesis_button_states[GEN_B];
-        genesis_button_states[GEN_B] = genesis_button_states[GEN_C];
-        genesis_button_states[GEN_C] = false;
+        /* Unplugged part way through, or not a mouse after all */
+        genesis_buttons[0] = 0;
+        genesis_mouse_buttons = 0;
+        genesis_pad_type[0] = GEN_TYPE_NONE;
+        probe_pending[0] = true;
+    }
+#endif
+    
+    /* The counter started from reset, so the second rising edge
+     * leaves a 6-button pad grounding all four direction lines with
+     * select low, and the third rising edge brings up the extra
+     * buttons. A Sports Pad sends its Y motion on the second pulse.
+     * Also see https://segaretro.org/Six_Button_Control_Pad_(Mega_Drive)
+     * (which counts the idle high state as a cycle of its own)
+     * Only ports with such a pad get the extra pulses. */
+    FOR_EACH_DIRECT(p)
+    {
+        if (needs_six[p] && six_phase[PAD_PORT(p)] == 1)
+            probe |= PAD_BIT(p);
+    }
+#ifdef GENESIS_SMS_ANALOG
+    second = probe | (sports ? PAD_PORT_BIT(0) : 0);
+    if (second)
+    {
+        mux_high(second);
+        pad_read_pressed(sports_y);
+        mux_low(second);
+        pad_read_pressed(detect);
+    }
+    if (sports)
+    {
+        nibbles[0] = mux1[0];
+        nibbles[1] = mux0[0];
+        nibbles[2] = sports_y[0];
+        nibbles[3] = detect[0];
+        read_sports_pad(nibbles);
+    }
+#else
+    if (probe)
+    {
+        mux_high(probe);
+        mux_low(probe);
+        pad_read_pressed(detect);
+    }
+#endif
+    
+    if (probe)
+    {
+        mux_high(probe);
+        pad_read_pressed(six);
+        mux_low(probe);
+    }
+    
+    FOR_EACH_DIRECT(p)
+    {
+        if (!needs_six[p])
+            continue;
+        
+        if (!(probe & PAD_BIT(p)))
+        {
+            /* Can't look for a 6-button pad until its counter has
+             * timed out; treat it as a 3-button pad until then */
+            genesis_pad_type[p] = GEN_TYPE_3_BUTTON;
+            probe_pending[p] = true;
+            continue;
+        }
         
-        genesis_pad_type = GEN_TYPE_1_2_BUTTON;
+        if ((detect[p] & ALL_DIRECTION_MASK) == ALL_DIRECTION_MASK)
+        {
+            genesis_buttons[p] |= decode_phase(six[p], &sixbutton_map);
+            genesis_pad_type[p] = GEN_TYPE_6_BUTTON;
+        }
+        else
+        {
+            genesis_pad_type[p] = GEN_TYPE_3_BUTTON;
+        }
+        probe_pending[p] = false;
+    }
+    
+    FOR_EACH_DIRECT(p)
+    {
+        if (is_direct_pad(p) && genesis_pad_type[p] != last_type[p])
+            changed = true;
+    }
+    
+    if (changed)
+    {
+        perf_pad_changed();
+        pad_types_changed(last_type);
     }
-
 }
@@ -14,7 +14,11 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#ifndef genesis_pad_h__
+#define genesis_pad_h__
+
 #include <stdbool.h>
+#include <stdint.h>
 
 /** Type for all available Sega Genesis buttons
  * 
@@ -41,17 +45,206 @@ enum genesis_buttons {
 enum genesis_type {
     GEN_TYPE_1_2_BUTTON = 0,
     GEN_TYPE_3_BUTTON,
-    GEN_TYPE_6_BUTTON
+    GEN_TYPE_6_BUTTON,
+    GEN_TYPE_MOUSE,         /**< Sega Mega Mouse (GENESIS_MEGA_MOUSE) */
+    GEN_TYPE_XE1AP,         /**< Dempa XE-1AP analog pad (GENESIS_XE1AP) */
+    GEN_TYPE_PADDLE,        /**< SMS Paddle Control (GENESIS_SMS_ANALOG) */
+    GEN_TYPE_SPORTS_PAD,    /**< SMS Sports Pad (GENESIS_SMS_ANALOG) */
+    GEN_TYPE_NONE           /**< No pad, or an idle 1/2 button pad */
 };
 
-/** Current pressed/release state of each Sega Genesis button */
-extern bool genesis_button_states[];
+/** Bit for a button in genesis_buttons. GEN_UNASSIGNED has no bit,
+ * so GEN_RIGHT is bit 0 and GEN_MODE is bit 11. */
+#define GEN_BIT(b) ((uint16_t)(1U << (b)) >> 1)
+
+/** All four direction bits, which occupy the lowest nibble */
+#define GEN_DIRECTION_BITS (GEN_BIT(GEN_RIGHT) | GEN_BIT(GEN_LEFT) | \
+    GEN_BIT(GEN_UP) | GEN_BIT(GEN_DOWN))
+
+/** Number of Genesis ports to scan. Ports are pulsed together
+ * whenever they can be, so scanning several costs about the same as
+ * one. */
+#ifndef GENESIS_NUM_PORTS
+#define GENESIS_NUM_PORTS 1
+#endif
+
+/* Multitap support. At most one of these may be defined:
+ * 
+ *  - GENESIS_TEAM_PLAYER: a Sega Team Player may be plugged into the
+ *    first port. Its players B-D get pads of their own after the
+ *    direct ports; player A takes the first port's pad.
+ *  - GENESIS_EA_4WAY: an EA 4-Way Play, with its second plug wired to
+ *    the Teensy's port D. Needs a single Genesis port. */
+#if defined(GENESIS_TEAM_PLAYER) && defined(GENESIS_EA_4WAY)
+#error "Only one multitap type can be supported at a time"
+#endif
+
+/** Sega Mega Mouse support (GENESIS_MEGA_MOUSE): a Mega Mouse may be
+ * plugged into the first port in place of a pad. It is read with its
+ * own handshake in the same select pulse as the direct pads, and its
+ * motion and buttons are kept apart from genesis_buttons. */
+#if defined(GENESIS_MEGA_MOUSE) && defined(GENESIS_EA_4WAY)
+#error "The Mega Mouse can't be read through an EA 4-Way Play"
+#endif
+
+/** Dempa XE-1AP support (GENESIS_XE1AP): an XE-1AP analog pad may be
+ * plugged into the first port. Its buttons are reported as Genesis
+ * buttons, its stick also as directions, and its analog axes are kept
+ * in genesis_axes. */
+#if defined(GENESIS_XE1AP) && defined(GENESIS_EA_4WAY)
+#error "The XE-1AP can't be read through an EA 4-Way Play"
+#endif
+
+/** Master System analog controller support (GENESIS_SMS_ANALOG): a
+ * Paddle Control (HPD-200) or a Sports Pad may be plugged into the
+ * first port. Their buttons are reported as A and B, and their
+ * positions are kept in genesis_axes. */
+#if defined(GENESIS_SMS_ANALOG) && defined(GENESIS_EA_4WAY)
+#error "SMS analog controllers can't be read through an EA 4-Way Play"
+#endif
+
+/** Defined when any analog controller is supported */
+#if defined(GENESIS_XE1AP) || defined(GENESIS_SMS_ANALOG)
+#define GENESIS_ANALOG
+#endif
 
-/** Which gamepad type is connected */
-extern enum genesis_type genesis_pad_type;
+/** Number of pads read directly through a pad port (or through the
+ * 4-Way Play's data multiplexer) using the select line */
+#ifdef GENESIS_EA_4WAY
+#define GENESIS_DIRECT_PADS 4
+#else
+#define GENESIS_DIRECT_PADS GENESIS_NUM_PORTS
+#endif
+
+/** Total number of pads (players) reported */
+#ifdef GENESIS_TEAM_PLAYER
+#define GENESIS_NUM_PADS (GENESIS_DIRECT_PADS + 3)
+#else
+#define GENESIS_NUM_PADS GENESIS_DIRECT_PADS
+#endif
+
+/** Current pressed state of each Sega Genesis button on each pad,
+ * one GEN_BIT each */
+extern uint16_t genesis_buttons[GENESIS_NUM_PADS];
+
+/** Which gamepad type is connected for each pad */
+extern enum genesis_type genesis_pad_type[GENESIS_NUM_PADS];
+
+/** Set while a multitap is detected on the first port */
+extern bool genesis_multitap;
+
+#ifdef GENESIS_MEGA_MOUSE
+/** Motion read from a Mega Mouse by the last genesis_load(), in mouse
+ * counts, with X to the right and Y downwards. Zero when no mouse is
+ * connected, or the mouse wasn't read that time. */
+extern int16_t genesis_mouse_dx;
+extern int16_t genesis_mouse_dy;
+
+/** Mega Mouse buttons currently pressed, one GENESIS_MOUSE_* bit each */
+extern uint8_t genesis_mouse_buttons;
+
+#define GENESIS_MOUSE_LEFT      0x01
+#define GENESIS_MOUSE_RIGHT     0x02
+#define GENESIS_MOUSE_MIDDLE    0x04
+#define GENESIS_MOUSE_START     0x08
+#endif
+
+#ifdef GENESIS_ANALOG
+/** Analog axes of an XE-1AP, paddle or Sports Pad */
+enum genesis_axis {
+    GEN_AXIS_X = 0,         /**< Stick, paddle or ball, 0 at the left */
+    GEN_AXIS_Y,             /**< Stick or ball, 0 at the top */
+    GEN_AXIS_THROTTLE,      /**< XE-1AP throttle, 0 at the bottom */
+    NUM_GEN_AXES
+};
 
-/** Prepare the input port for use */
+/** Analog axis positions, from 0 to 255, of an analog controller on
+ * the first port. Only updated while one is connected. Axes the
+ * controller lacks rest at the centre (the throttle at 0). A Sports
+ * Pad's motion is added up into a position, starting centred. */
+extern uint8_t genesis_axes[NUM_GEN_AXES];
+#endif
+
+/** Longest settle time allowed after a mux change, in microseconds.
+ * Also used when calibration finds nothing responding to the mux. */
+#define GENESIS_SETTLE_MAX_US 100
+
+/** Fixed margin added to twice the measured settle time */
+#define GENESIS_SETTLE_MARGIN_US 2
+
+/** Time without select edges after which a 6-button pad's select
+ * counter is known to have reset (nominally about 1.5ms). A 6-button
+ * pad can only be fully read this often; scans in between refresh
+ * A and Start only, and leave its port's select line alone. Pads on
+ * the other ports are still read in full. */
+#define GENESIS_SIX_TIMEOUT_US 1800
+
+/** Longest time allowed for an XE-1AP to send all of its data */
+#define GENESIS_XE1AP_TIMEOUT_US 200
+
+/** Longest wait for an XE-1AP to start sending. Nothing may be
+ * connected, so this is all an unanswered attempt costs; the empty
+ * port is only tried every few dozen scans. */
+#define GENESIS_XE1AP_START_US 30
+
+/** Longest wait for a paddle to toggle TR, which it does by itself
+ * every 60us or so. Nothing may be connected, so this is all looking
+ * for one costs; that is only done every few dozen scans. */
+#define GENESIS_PADDLE_START_US 80
+
+/** Longest time allowed to read a paddle's position, which can take
+ * three of its half periods */
+#define GENESIS_PADDLE_TIMEOUT_US 250
+
+/** Time without select edges after which a Sports Pad starts its
+ * next transfer afresh, with the high nibble of X */
+#define GENESIS_SPORTS_PAD_RESET_US 400
+
+/** Time allowed for the pad lines to settle after a mux change, in
+ * microseconds, as chosen by the last calibration. Also reported on
+ * the performance counters page. */
+extern uint8_t genesis_settle_us;
+
+/** Prepare the input ports for use, calibrating the settle time */
 void genesis_init(void);
 
-/** Load the current button states into the data array */
+/** Measure how quickly the pads on every port respond to the mux line
+ * and choose the settle time to suit the slowest. Blocks for a little
+ * over 2ms while a 6-button pad's counter times out, so it is only
+ * done at power-up. */
+void genesis_calibrate(void);
+
+/** Measure the next port with a pad plugged in since power-up, if
+ * any, and choose the settle time again. genesis_load() only uses the
+ * longest settle time for such a pad until then. Takes up to about
+ * 0.5ms, so call it between scans rather than in the way of one. */
+void genesis_calibrate_next(void);
+
+/** Set by a pad line changing while armed with genesis_wake_arm() */
+extern volatile bool genesis_woken;
+
+/** Arm the first pad port to wake the MCU from sleep when a line
+ * changes. Select is held high meanwhile, so any direction, B or C
+ * wakes it. Call genesis_wake_disarm() before reading the pads again. */
+void genesis_wake_arm(void);
+
+void genesis_wake_disarm(void);
+
+/** Load the current button states of every pad into genesis_buttons.
+ * 
+ * The pad type of each port is remembered between calls. It is only detected again
+ * after the pad reads as disconnected or reports something inconsistent
+ * with that type. While nothing is connected, all buttons read as
+ * released. A Team Player is read in the same select pulse as the
+ * direct pads, using its own handshake, and takes roughly 10us per
+ * nibble (3 for each 6-button pad). So is a Mega Mouse, which takes
+ * 8 nibbles, each allowed up to 100us. An XE-1AP sends its data by
+ * itself as soon as select falls, so it is read with interrupts
+ * disabled for up to GENESIS_XE1AP_TIMEOUT_US, kept clear of the USB
+ * start-of-frame; an empty first port is only checked for one every
+ * XE1AP_PROBE_SCANS scans. A paddle ignores select and is read in up to
+ * GENESIS_PADDLE_TIMEOUT_US, and a Sports Pad takes two select pulses
+ * like a 6-button pad. */
 void genesis_load(void);
+
+#endif
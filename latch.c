@@ -0,0 +1,68 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "latch.h"
+#include "settings.h"
+
+
+/** Horizontal and vertical direction bits */
+#define LEFT_RIGHT_BITS (GEN_BIT(GEN_LEFT) | GEN_BIT(GEN_RIGHT))
+#define UP_DOWN_BITS (GEN_BIT(GEN_UP) | GEN_BIT(GEN_DOWN))
+
+/** Presses sampled on each pad since its last report */
+static uint16_t latched[GENESIS_NUM_PADS];
+
+/** Presses already reported on each pad, kept until those reports
+ * are on their way to the host */
+static uint16_t reported[GENESIS_NUM_PADS];
+
+
+void latch_sample(uint8_t pad, uint16_t buttons)
+{
+    latched[pad] |= buttons;
+}
+
+
+uint16_t latch_filter(uint8_t pad, uint16_t buttons)
+{
+    uint16_t extra = latched[pad] | reported[pad];
+    
+    switch (settings.latch)
+    {
+    case LATCH_OFF:
+        return buttons;
+    case LATCH_BUTTONS:
+        extra &= ~GEN_DIRECTION_BITS;
+        break;
+    default:
+        /* Don't let a tap the other way fight a direction held now */
+        if (buttons & LEFT_RIGHT_BITS)
+            extra &= ~LEFT_RIGHT_BITS;
+        if (buttons & UP_DOWN_BITS)
+            extra &= ~UP_DOWN_BITS;
+        break;
+    }
+    
+    reported[pad] |= latched[pad] | buttons;
+    latched[pad] = 0;
+    return buttons | extra;
+}
+
+
+void latch_clear(uint8_t pad)
+{
+    reported[pad] = 0;
+}
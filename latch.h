@@ -0,0 +1,62 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef latch_h__
+#define latch_h__
+
+#include <stdint.h>
+
+#include "genesis_pad.h"
+#include "scan_sched.h"
+
+/** Press latching policies (settings.latch) */
+#define LATCH_OFF       0   /**< Report the state at the last scan only */
+#define LATCH_BUTTONS   1   /**< Latch button presses */
+#define LATCH_ALL       2   /**< Latch button and direction presses */
+#define NUM_LATCH_MODES 3
+
+/** Rate at which the pads are sampled between reports while
+ * latching, in Hz */
+#ifndef OVERSAMPLE_HZ
+#define OVERSAMPLE_HZ 4000
+#endif
+
+/** Time between samples, in timer ticks */
+#define OVERSAMPLE_TICKS SCHED_US(1000000UL / OVERSAMPLE_HZ)
+
+/** Record one sample of a pad's button bits, so any press in it is
+ * reported even if released before the next report
+ * 
+ * \param pad Which pad the sample came from
+ * \param buttons Button bits, after debouncing
+ */
+void latch_sample(uint8_t pad, uint16_t buttons);
+
+/** Add the presses latched since the last report, and those in
+ * reports that haven't reached the host yet, to a pad's button bits. A direction held now wins over a latched one on the
+ * same axis.
+ * 
+ * \param pad Which pad the button bits came from
+ * \param buttons Button bits, after debouncing
+ * \return Button bits to report
+ */
+uint16_t latch_filter(uint8_t pad, uint16_t buttons);
+
+/** Forget the presses already put in a pad's reports, once those
+ * reports are on their way to the host */
+void latch_clear(uint8_t pad);
+
+#endif
@@ -0,0 +1,332 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef pad_hal_h__
+#define pad_hal_h__
+
+/* Hardware access for the pad ports. Everything that touches the
+ * port registers directly lives here, so the pad logic itself only
+ * deals in port values.
+ * 
+ * Every port uses the same pin layout as port B (see readme.md),
+ * except port D, where the Teensy LED sits on D6: its A/B line moves
+ * to D7 instead, and reads are shuffled back into the common layout.
+ * Each port's select line can be driven on its own, so a 6-button
+ * pad's counter on one port doesn't hold back the pads on the others. */
+
+#ifdef PAD_HAL_HOST
+/* Host test build: the same calls, answered by pad models */
+#include "pad_hal_host.h"
+#else
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <util/delay.h>
+
+/** Number of Genesis ports to scan */
+#ifndef GENESIS_NUM_PORTS
+#define GENESIS_NUM_PORTS 1
+#endif
+
+/* Ports available for pads, in order of use */
+#if defined(__AVR_ATmega32U4__)
+#define PAD_MAX_PORTS 2         /* B, D */
+#define PAD_PORT1_D
+#elif defined(__AVR_AT90USB646__) || defined(__AVR_AT90USB1286__)
+#define PAD_MAX_PORTS 4         /* B, C, F, D */
+#define PAD_PORT1_C
+#define PAD_PORT2_F
+#define PAD_PORT3_D
+#else
+#define PAD_MAX_PORTS 1         /* B */
+#endif
+
+#if GENESIS_NUM_PORTS > PAD_MAX_PORTS
+#error "More Genesis ports requested than this MCU has available"
+#endif
+
+#if defined(GENESIS_EA_4WAY) && (GENESIS_NUM_PORTS > 1 || PAD_MAX_PORTS < 2)
+#error "The EA 4-Way Play needs port D, so only one Genesis port"
+#endif
+
+#if GENESIS_NUM_PORTS > 2 && defined(BENCH_PROBE)
+#error "Timing probes share port F with the third Genesis port"
+#endif
+
+/** Which pin of each pad port is used for mux (select) control */
+#define PAD_SELECT_PIN 5
+
+/** Bit for a pad port in the masks taken by pad_select_high() and
+ * pad_select_low() */
+#define PAD_PORT_BIT(port) (1 << (port))
+
+/** Mask of every pad port in use */
+#define PAD_ALL_PORTS ((1 << GENESIS_NUM_PORTS) - 1)
+
+/** Mask of the pad port pins carrying pad data */
+#define PAD_DATA_MASK 0x5F
+
+/** Which pin of the first pad port carries TR (pin 9, C/Start),
+ * driven by us to clock a Team Player */
+#define PAD_TR_PIN 4
+
+/** Which pin of the first pad port carries TL (pin 6, A/B), used by
+ * a Team Player to acknowledge each nibble */
+#define PAD_TL_PIN 6
+
+/** Shuffle a port D value into the common pin layout */
+#define PAD_FROM_PORTD(v) (((v) & 0x3F) | (((v) >> 1) & 0x40) | 0x80)
+
+/** Configure one pad port: pull-ups on all inputs, select driven low */
+#define PAD_PORT_INIT(port) \
+    do { \
+        DDR##port = (1 << PAD_SELECT_PIN); \
+        PORT##port = 0xFF & ~(1 << PAD_SELECT_PIN); \
+    } while (0)
+
+#ifdef GENESIS_EA_4WAY
+/* The 4-Way Play's second plug is driven from port D, in the same
+ * pin layout (TL on D7). Its TL and TR lines pick the player whose
+ * data lines are passed through to the first port; TH stays low. */
+
+/** Port D pins driven for the 4-Way Play (all but the LED on D6) */
+#define PAD_4WAY_MASK 0xBF
+
+/** Port D value selecting a 4-Way Play player: TL = bit 0 and TR =
+ * bit 1 of the player number, with the Left and Right lines high */
+#define PAD_4WAY_SELECT(player) \
+    ((((player) & 1) << 7) | (((player) & 2) << 3) | 0x03)
+
+/** Port D value for the 4-Way Play's detection state: TH, TR and TL
+ * high, and the Left and Right lines high */
+#define PAD_4WAY_DETECT (0x80 | (1 << 5) | (1 << 4) | 0x03)
+
+/** Time for the 4-Way Play's multiplexer and the data lines to
+ * follow a new player selection */
+#define PAD_4WAY_SETTLE_US 2
+
+/** Route a 4-Way Play player's data lines to the first pad port
+ * 
+ * \param player Player, from 0 to 3
+ */
+static inline void pad_4way_select(uint8_t player)
+{
+    PORTD = (PORTD & ~PAD_4WAY_MASK) | PAD_4WAY_SELECT(player);
+    _delay_us(PAD_4WAY_SETTLE_US);
+}
+
+/** Check for a 4-Way Play. In its detection state it loops Up and
+ * Down on the first port low, which no real pad does. Call with the
+ * select line high.
+ * 
+ * \return true if a 4-Way Play is connected
+ */
+static inline bool pad_4way_detect(void)
+{
+    bool found;
+    
+    PORTD = (PORTD & ~PAD_4WAY_MASK) | PAD_4WAY_DETECT;
+    _delay_us(PAD_4WAY_SETTLE_US);
+    found = !(PINB & ((1 << 3) | (1 << 2)));
+    pad_4way_select(0);
+    return found;
+}
+#endif
+
+/** Configure all pad ports */
+static inline void pad_port_init(void)
+{
+    PAD_PORT_INIT(B);
+#if GENESIS_NUM_PORTS > 1
+#ifdef PAD_PORT1_D
+    PAD_PORT_INIT(D);
+#else
+    PAD_PORT_INIT(C);
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    /* Port F doubles as the JTAG port; release it for I/O. JTD must
+     * be written twice within four cycles to take effect. */
+    MCUCR = (1 << JTD);
+    MCUCR = (1 << JTD);
+    PAD_PORT_INIT(F);
+#endif
+#if GENESIS_NUM_PORTS > 3
+    PAD_PORT_INIT(D);
+#endif
+#ifdef GENESIS_EA_4WAY
+    DDRD |= PAD_4WAY_MASK;
+    pad_4way_select(0);
+#endif
+}
+
+/** Read a pad port value, in the common pin layout
+ * 
+ * \param port Pad port number, from 0 to GENESIS_NUM_PORTS - 1
+ */
+static inline uint8_t pad_read(uint8_t port)
+{
+    switch (port)
+    {
+#if GENESIS_NUM_PORTS > 1
+    case 1:
+#ifdef PAD_PORT1_D
+        return PAD_FROM_PORTD(PIND);
+#else
+        return PINC;
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    case 2:
+        return PINF;
+#endif
+#if GENESIS_NUM_PORTS > 3
+    case 3:
+        return PAD_FROM_PORTD(PIND);
+#endif
+    default:
+        return PINB;
+    }
+}
+
+/** Read all pad ports back to back, inverted so pressed (grounded)
+ * lines read as 1
+ * 
+ * \param pressed Array of GENESIS_NUM_PORTS values to fill in
+ */
+static inline void pad_read_pressed(uint8_t pressed[])
+{
+    /* Raw reads first, one in instruction each, so the ports are
+     * sampled as close together as possible; port D's shuffling and
+     * the inversion happen afterwards */
+    uint8_t p0 = PINB;
+#if GENESIS_NUM_PORTS > 1
+#ifdef PAD_PORT1_D
+    uint8_t p1 = PIND;
+#else
+    uint8_t p1 = PINC;
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    uint8_t p2 = PINF;
+#endif
+#if GENESIS_NUM_PORTS > 3
+    uint8_t p3 = PIND;
+#endif
+    
+    pressed[0] = ~p0;
+#if GENESIS_NUM_PORTS > 1
+#ifdef PAD_PORT1_D
+    pressed[1] = ~PAD_FROM_PORTD(p1);
+#else
+    pressed[1] = ~p1;
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    pressed[2] = ~p2;
+#endif
+#if GENESIS_NUM_PORTS > 3
+    pressed[3] = ~PAD_FROM_PORTD(p3);
+#endif
+}
+
+/** Let a change on the first pad port's data lines wake the MCU from
+ * sleep, through the pin change interrupt (PCINT0-7 are port B) */
+static inline void pad_wake_enable(void)
+{
+    PCMSK0 = PAD_DATA_MASK;
+    PCIFR = (1 << PCIF0);
+    PCICR |= (1 << PCIE0);
+}
+
+static inline void pad_wake_disable(void)
+{
+    PCICR &= ~(1 << PCIE0);
+    PCMSK0 = 0;
+}
+
+/** Drive TR on the first pad port. Low is driven, while high is left
+ * to the pull-up, so a pad that drives this line itself (when mistaken
+ * for a Team Player) is never fought. */
+static inline void pad_tr_high(void)
+{
+    DDRB &= ~(1 << PAD_TR_PIN);
+    PORTB |= (1 << PAD_TR_PIN);
+}
+
+static inline void pad_tr_low(void)
+{
+    PORTB &= ~(1 << PAD_TR_PIN);
+    DDRB |= (1 << PAD_TR_PIN);
+}
+
+/** Drive the select lines of some pad ports high. A constant mask
+ * compiles to one sbi per port.
+ * 
+ * \param ports Ports to drive, one PAD_PORT_BIT() each
+ */
+static inline void pad_select_high(uint8_t ports)
+{
+    if (ports & PAD_PORT_BIT(0))
+        PORTB |= (1 << PAD_SELECT_PIN);
+#if GENESIS_NUM_PORTS > 1
+    if (ports & PAD_PORT_BIT(1))
+#ifdef PAD_PORT1_D
+        PORTD |= (1 << PAD_SELECT_PIN);
+#else
+        PORTC |= (1 << PAD_SELECT_PIN);
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    if (ports & PAD_PORT_BIT(2))
+        PORTF |= (1 << PAD_SELECT_PIN);
+#endif
+#if GENESIS_NUM_PORTS > 3
+    if (ports & PAD_PORT_BIT(3))
+        PORTD |= (1 << PAD_SELECT_PIN);
+#endif
+}
+
+/** Drive the select lines of some pad ports low
+ * 
+ * \param ports Ports to drive, one PAD_PORT_BIT() each
+ */
+static inline void pad_select_low(uint8_t ports)
+{
+    if (ports & PAD_PORT_BIT(0))
+        PORTB &= ~(1 << PAD_SELECT_PIN);
+#if GENESIS_NUM_PORTS > 1
+    if (ports & PAD_PORT_BIT(1))
+#ifdef PAD_PORT1_D
+        PORTD &= ~(1 << PAD_SELECT_PIN);
+#else
+        PORTC &= ~(1 << PAD_SELECT_PIN);
+#endif
+#endif
+#if GENESIS_NUM_PORTS > 2
+    if (ports & PAD_PORT_BIT(2))
+        PORTF &= ~(1 << PAD_SELECT_PIN);
+#endif
+#if GENESIS_NUM_PORTS > 3
+    if (ports & PAD_PORT_BIT(3))
+        PORTD &= ~(1 << PAD_SELECT_PIN);
+#endif
+}
+
+#endif /* PAD_HAL_HOST */
+
+#endif
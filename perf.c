@@ -0,0 +1,50 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "perf.h"
+
+
+perf_counters_t perf = { .scan_min = 0xFFFF };
+
+
+void perf_reset(void)
+{
+    uint8_t settle;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        settle = perf.settle_us;
+        memset(&perf, 0, sizeof(perf));
+        perf.scan_min = 0xFFFF;
+        perf.settle_us = settle;
+    }
+}
+
+
+void perf_scan(uint16_t ticks)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (ticks < perf.scan_min)
+            perf.scan_min = ticks;
+        if (ticks > perf.scan_max)
+            perf.scan_max = ticks;
+        perf.scan_total += ticks;
+        perf.scans++;
+    }
+}
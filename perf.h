@@ -0,0 +1,83 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef perf_h__
+#define perf_h__
+
+/* Performance counters, kept at all times and read by the host
+ * through the diagnostics feature report (see readme.md and
+ * tools/perfstat.c). Times are in scheduler timer ticks (0.5us).
+ * The layout is sent as is, so keep the host tool in step when
+ * changing it. */
+
+#include <stdint.h>
+#include <util/atomic.h>
+
+#include "scan_sched.h"
+
+typedef struct {
+    uint16_t scan_min;          /**< Shortest genesis_load() */
+    uint16_t scan_max;          /**< Longest genesis_load() */
+    uint32_t scan_total;        /**< Total time in genesis_load() */
+    uint32_t scans;             /**< Number of scans */
+    uint32_t frames;            /**< USB frames (start-of-frames) seen */
+    uint32_t mailbox_wait;      /**< Time reports waited for a free bank */
+    uint16_t mailbox_dropped;   /**< Reports replaced before being sent */
+    uint16_t pad_changes;       /**< Pad types detected on a port */
+    uint32_t isr_time;          /**< Time in the USB interrupts */
+    uint16_t playback_underruns;    /**< Frames played back late */
+    uint8_t settle_us;          /**< Mux settle time in use, in us; not
+                                     a counter, so kept by perf_reset() */
+} perf_counters_t;
+
+/** Counters since power-up or the last perf_reset(). Updated from
+ * interrupts too, so only access them with interrupts disabled. */
+extern perf_counters_t perf;
+
+/** Clear all counters */
+void perf_reset(void);
+
+/** Count one scan
+ * 
+ * \param ticks How long genesis_load() took
+ */
+void perf_scan(uint16_t ticks);
+
+/** Count a change of detected pad type */
+static inline void perf_pad_changed(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        perf.pad_changes++;
+    }
+}
+
+/** Record the mux settle time in use (genesis_settle_us) */
+static inline void perf_settle(uint8_t us)
+{
+    perf.settle_us = us;
+}
+
+/** Add the time spent in a USB interrupt. Call from the interrupt.
+ * 
+ * \param start Timer value on entry
+ */
+static inline void perf_isr_done(uint16_t start)
+{
+    perf.isr_time += (uint16_t)(sched_now() - start);
+}
+
+#endif
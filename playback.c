@@ -0,0 +1,144 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "playback.h"
+
+#ifdef PLAYBACK
+#include <string.h>
+#include <util/atomic.h>
+
+#include "perf.h"
+
+#if PLAYBACK_FRAMES & (PLAYBACK_FRAMES - 1)
+#error "PLAYBACK_FRAMES must be a power of 2"
+#endif
+#if PLAYBACK_FRAMES > 128
+#error "PLAYBACK_FRAMES must be at most 128"
+#endif
+
+
+volatile bool playback_active = false;
+
+volatile uint16_t playback_buttons[GENESIS_NUM_PADS];
+
+/** Buffered frames, oldest at frame_tail. Filled by main() and
+ * emptied by the start-of-frame interrupt. */
+static uint16_t frames[PLAYBACK_FRAMES][GENESIS_NUM_PADS];
+static volatile uint8_t frame_head = 0;
+static volatile uint8_t frame_tail = 0;
+
+/** Set once the host has sent the last frame of the stream */
+static volatile bool stream_ending = false;
+
+/** Set between a stream starting and the pad ending it, so frames
+ * still arriving after an override are thrown away */
+static bool stream_open = false;
+
+
+uint8_t playback_room(void)
+{
+    return PLAYBACK_FRAMES - (uint8_t)(frame_head - frame_tail);
+}
+
+
+void playback_start(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        frame_tail = frame_head;
+        stream_ending = false;
+        playback_active = false;
+    }
+    stream_open = true;
+}
+
+
+void playback_end(void)
+{
+    if (stream_open)
+    {
+        stream_ending = true;
+        stream_open = false;
+    }
+}
+
+
+void playback_push(const uint16_t *frame)
+{
+    if (!stream_open)
+        return;
+    
+    memcpy(frames[frame_head % PLAYBACK_FRAMES], frame, PLAYBACK_FRAME_SIZE);
+    /* Only publish the frame once it has been copied */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        frame_head++;
+    }
+}
+
+
+void playback_next_frame(void)
+{
+    uint8_t pad;
+    
+    if (frame_head == frame_tail)
+    {
+        /* Ran dry: hold the last frame until more arrives */
+        if (stream_ending)
+        {
+            playback_active = false;
+            stream_ending = false;
+        }
+        else if (playback_active)
+        {
+            perf.playback_underruns++;
+        }
+        return;
+    }
+    
+    for (pad = 0; pad < GENESIS_NUM_PADS; pad++)
+    {
+        playback_buttons[pad] = frames[frame_tail % PLAYBACK_FRAMES][pad];
+    }
+    frame_tail++;
+    playback_active = true;
+}
+
+
+void playback_check_override(const uint16_t *buttons)
+{
+    uint8_t pad;
+    
+    if (!playback_active && !stream_open)
+        return;
+    
+    for (pad = 0; pad < GENESIS_NUM_PADS; pad++)
+    {
+        if (buttons[pad])
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                playback_active = false;
+                stream_ending = false;
+                frame_tail = frame_head;
+            }
+            stream_open = false;
+            return;
+        }
+    }
+}
+
+#endif
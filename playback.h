@@ -0,0 +1,86 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef playback_h__
+#define playback_h__
+
+/* Input playback. When built with PLAYBACK defined (make
+ * PLAYBACK=1), the host can stream recorded input over a
+ * vendor-specific interrupt OUT endpoint, and the converter reports
+ * it in place of the pads, one frame of input per USB frame. Pressing
+ * any button on a pad ends playback straight away. See readme.md for
+ * the stream format. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "genesis_pad.h"
+
+#ifdef PLAYBACK
+
+/** Flags in the first byte of each playback packet */
+#define PLAYBACK_START  0x01    /**< Start a new playback, dropping any
+                                     frames still buffered */
+#define PLAYBACK_END    0x02    /**< End once the buffered frames
+                                     have played */
+
+/** Size of one frame of input: Genesis button bits for each pad,
+ * 16 bits each, little-endian */
+#define PLAYBACK_FRAME_SIZE (GENESIS_NUM_PADS * 2)
+
+/** Frames buffered ahead of playback. Must be a power of 2, up to
+ * 128. */
+#ifndef PLAYBACK_FRAMES
+#define PLAYBACK_FRAMES 64
+#endif
+
+/** Set while playing back. Cleared from the start-of-frame interrupt
+ * when the stream ends. */
+extern volatile bool playback_active;
+
+/** Button bits of each pad for the current frame, while playing */
+extern volatile uint16_t playback_buttons[GENESIS_NUM_PADS];
+
+/** Number of frames that can be buffered right now */
+uint8_t playback_room(void);
+
+/** Start a new stream, dropping any frames still buffered */
+void playback_start(void);
+
+/** End the stream once the frames buffered so far have played */
+void playback_end(void);
+
+/** Buffer one frame of input to play, unless the stream has ended or
+ * was ended by the pad. Check playback_room() first.
+ * 
+ * \param frame Genesis button bits for each pad
+ */
+void playback_push(const uint16_t *frame);
+
+/** Move on to the next frame. Call from the start-of-frame interrupt. */
+void playback_next_frame(void);
+
+/** End playback if any button is pressed on a pad
+ * 
+ * \param buttons Button bits read from each pad
+ */
+void playback_check_override(const uint16_t *buttons);
+
+#else
+#define playback_active false
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef probe_h__
+#define probe_h__
+
+/* Timing probes for benchmarking. When built with BENCH_PROBE
+ * defined (make PROBE=1), each probe drives a spare pin high for the
+ * duration of the event it marks. Capturing those pins with a logic
+ * analyser, or as a VCD trace from an AVR simulator such as simavr,
+ * gives cycle-exact timings for each event. Without BENCH_PROBE the
+ * probes compile to nothing. */
+
+#ifdef BENCH_PROBE
+#include <avr/io.h>
+
+#if defined(__AVR_AT90USB162__)
+#define PROBE_PORT  PORTC
+#define PROBE_DDR   DDRC
+#else
+#define PROBE_PORT  PORTF
+#define PROBE_DDR   DDRF
+#endif
+
+/** Probe pins, one per event type */
+enum probe_pin {
+    PROBE_SCAN = 4,         /**< genesis_load() in progress */
+    PROBE_PUBLISH = 5,      /**< usb_gamepad_send() publishing a report */
+    PROBE_REPORT = 6,       /**< Writing the report to the endpoint */
+    PROBE_USB_ISR = 7       /**< Inside a USB interrupt handler */
+};
+
+#define PROBE_MASK  0xF0
+
+/* Single sbi/cbi instructions, so each probe edge costs 2 cycles */
+#define probe_init()    (PROBE_DDR |= PROBE_MASK)
+#define probe_begin(p)  (PROBE_PORT |= (1 << (p)))
+#define probe_end(p)    (PROBE_PORT &= ~(1 << (p)))
+
+#else
+#define probe_init()
+#define probe_begin(p)
+#define probe_end(p)
+#endif
+
+#endif
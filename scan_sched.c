@@ -0,0 +1,195 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "scan_sched.h"
+#include "usb_gamepad.h"
+
+
+uint16_t sched_scan_ticks = 0;
+
+/** Timer value when the current/last scan started */
+static uint16_t scan_start;
+
+/** Frame number of the poll the last scan was aimed at */
+static uint8_t scanned_for_frame;
+
+/** Timer value when the next scan is due, as last predicted. Only
+ * approximate, as each start-of-frame may move it. */
+static uint16_t next_scan;
+
+/** Don't bother sleeping for less than this, in timer ticks */
+#define SLEEP_MIN_TICKS SCHED_US(10)
+
+/** Margin kept before a start-of-frame by sched_clear_of_sof(), for
+ * crystal drift and the time taken to enter the interrupt */
+#define SOF_MARGIN_TICKS SCHED_US(10)
+
+
+/* The compare match only has to end the sleep */
+EMPTY_INTERRUPT(TIMER1_COMPA_vect);
+
+
+void sched_init(void)
+{
+    TCCR1A = 0;
+    TCCR1B = (1 << CS11);
+    scan_start = sched_now();
+}
+
+
+/** Check whether the next scan should start now, so that it
+ * completes SCHED_LEAD_TICKS ahead of the next expected poll. */
+static bool scan_due(void)
+{
+    uint16_t sof_time, offset, target;
+    uint8_t sof_frame, next, interval, frames;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        sof_time = usb_sof_time;
+        sof_frame = usb_sof_frame;
+        offset = usb_poll_offset;
+        next = usb_poll_frame;
+        interval = usb_poll_interval;
+    }
+
+    /* Polling stopped or was reset since we last looked */
+    if (interval == 0)
+        return true;
+
+    /* Step forward past the poll we already aimed at, as well as
+     * any polls the host skipped or we missed */
+    do
+    {
+        next += interval;
+    } while ((int8_t)(next - sof_frame) < 0 || next == scanned_for_frame);
+
+    /* Only predict across a couple of frames, so crystal drift stays
+     * negligible and the target stays within the timer range */
+    frames = next - sof_frame;
+    if (frames > 2)
+    {
+        /* Look again after the next start-of-frame */
+        next_scan = sof_time + 2 * SCHED_FRAME_TICKS;
+        return false;
+    }
+
+    target = sof_time + frames * SCHED_FRAME_TICKS + offset
+        - sched_scan_ticks - SCHED_LEAD_TICKS;
+    next_scan = target;
+    if ((int16_t)(sched_now() - target) < 0)
+        return false;
+
+    scanned_for_frame = next;
+    return true;
+}
+
+
+bool sched_scan_ready(void)
+{
+    if (usb_poll_interval == 0)
+    {
+        /* Host isn't polling yet (or too slowly to predict), so just
+         * pace one scan per frame. */
+        next_scan = scan_start + SCHED_FRAME_TICKS;
+        if ((uint16_t)(sched_now() - scan_start) < SCHED_FRAME_TICKS)
+            return false;
+    }
+    else if (!scan_due())
+    {
+        return false;
+    }
+
+    scan_start = sched_now();
+    return true;
+}
+
+
+void sched_wait_for_scan(void)
+{
+    /* Re-evaluate while waiting, so each new start-of-frame
+     * re-anchors the target against the host's clock */
+    while (!sched_scan_ready())
+        sched_idle(next_scan);
+}
+
+
+void sched_idle(uint16_t until)
+{
+    if ((int16_t)(next_scan - until) < 0)
+        until = next_scan;
+    sched_idle_until(until);
+}
+
+
+void sched_idle_until(uint16_t until)
+{
+    cli();
+    if ((int16_t)(until - sched_now()) >= (int16_t)SLEEP_MIN_TICKS)
+    {
+        OCR1A = until;
+        TIFR1 = (1 << OCF1A);
+        TIMSK1 |= (1 << OCIE1A);
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        /* sei only takes effect after the next instruction, so no
+         * interrupt can slip in before the sleep */
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        TIMSK1 &= ~(1 << OCIE1A);
+    }
+    sei();
+}
+
+
+void sched_clear_of_sof(uint16_t ticks)
+{
+    uint16_t sof_time, since;
+    uint8_t sof_frame;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        sof_time = usb_sof_time;
+        sof_frame = usb_sof_frame;
+    }
+    
+    since = sched_now() - sof_time;
+    if (since >= SCHED_FRAME_TICKS
+        || since + ticks + SOF_MARGIN_TICKS < SCHED_FRAME_TICKS)
+    {
+        return;
+    }
+    
+    /* Let the next start-of-frame be taken first. The wait is bounded
+     * in case the host stops sending frames meanwhile. */
+    while (usb_sof_frame == sof_frame
+        && (uint16_t)(sched_now() - sof_time)
+            < SCHED_FRAME_TICKS + SOF_MARGIN_TICKS)
+    {
+    }
+}
+
+
+void sched_scan_done(void)
+{
+    sched_scan_ticks = sched_now() - scan_start;
+}
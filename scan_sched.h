@@ -0,0 +1,99 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef scan_sched_h__
+#define scan_sched_h__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+/** Timer 1 runs free at clk/8, so one tick is 0.5us at 16 MHz */
+#define SCHED_TICKS_PER_US  (F_CPU / 8000000UL)
+
+/** Convert a time in microseconds to timer ticks */
+#define SCHED_US(us)        ((uint16_t)((us) * SCHED_TICKS_PER_US))
+
+/** Length of one full-speed USB frame in timer ticks */
+#define SCHED_FRAME_TICKS   SCHED_US(1000)
+
+/** Default safety margin between the end of a scan and the host's
+ * interrupt-IN poll. The scan duration itself is measured, so this
+ * only has to cover ISR jitter and the endpoint bank write. */
+#ifndef SCAN_LEAD_US
+#define SCAN_LEAD_US        50
+#endif
+
+/** Extra lead time (in timer ticks) kept before the predicted poll */
+#define SCHED_LEAD_TICKS    SCHED_US(SCAN_LEAD_US)
+
+/** Duration of the most recent scan, in timer ticks */
+extern uint16_t sched_scan_ticks;
+
+/** Current free-running timer value */
+static inline uint16_t sched_now(void)
+{
+    return TCNT1;
+}
+
+/** Start the scheduler timebase */
+void sched_init(void);
+
+/** Block until it is time to start the next scan.
+ *
+ * Once the host is polling, this aims to finish the scan just before
+ * the next expected interrupt-IN poll, as predicted from the last
+ * measured poll and the start-of-frame timestamps. Before then, it
+ * simply paces scans at one per USB frame. */
+void sched_wait_for_scan(void);
+
+/** Check whether it is time to start the next scan, without
+ * blocking, for callers with other work to do while they wait.
+ * Returns true at most once per scan, as sched_wait_for_scan()
+ * would have returned. */
+bool sched_scan_ready(void);
+
+/** Sleep the CPU until the given timer value, or until the next scan
+ * is due if that is sooner. Any interrupt (such as the USB
+ * start-of-frame) ends the sleep early, so callers should check for
+ * work and call again. Call after sched_scan_ready() returned false.
+ * 
+ * \param until Timer value to wake up at
+ */
+void sched_idle(uint16_t until);
+
+/** Sleep the CPU until the given timer value, whatever the scan
+ * schedule, for waits while no scans run (such as during a USB
+ * suspend, when the next scan time is stale). Interrupts end the
+ * sleep early, as with sched_idle().
+ * 
+ * \param until Timer value to wake up at
+ */
+void sched_idle_until(uint16_t until);
+
+/** Wait, if need be, until a stretch of the given length can run
+ * with interrupts disabled without holding up the next start-of-frame
+ * interrupt, whose timestamp the phase lock relies on. Returns at
+ * once if no frames are arriving.
+ * 
+ * \param ticks Length of the stretch, in timer ticks
+ */
+void sched_clear_of_sof(uint16_t ticks);
+
+/** Mark the end of a scan, so the next lead time accounts for it */
+void sched_scan_done(void);
+
+#endif
@@ -0,0 +1,68 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "settings.h"
+#include "usb_gamepad.h"
+#include "latch.h"
+
+
+/** Default button mapping: A, B and C on buttons 1-3, X, Y and Z on
+ * buttons 4-6, and Mode and Start on buttons 9 and 10 (Select and
+ * Start) */
+#define DEFAULT_REMAP { 1, 2, 3, 10, 4, 5, 6, 9 }
+
+/** Settings used when EEPROM holds nothing valid */
+static const settings_t PROGMEM default_settings = {
+    .version = SETTINGS_VERSION,
+    .poll_interval = GAMEPAD_INTERVAL,
+    .personality = USB_PERSONALITY_GAMEPAD,
+    .profile = 0,
+    .remap = { [0 ... REMAP_PROFILES - 1] = DEFAULT_REMAP },
+    .latch = LATCH_BUTTONS
+};
+
+/** EEPROM copy of the settings */
+static settings_t EEMEM eeprom_settings;
+
+settings_t settings;
+
+
+void settings_load(void)
+{
+    eeprom_read_block(&settings, &eeprom_settings, sizeof(settings_t));
+    
+    if (settings.version != SETTINGS_VERSION
+        || settings.poll_interval == 0
+        || settings.personality >= USB_NUM_PERSONALITIES
+#ifndef USB_XINPUT
+        || settings.personality == USB_PERSONALITY_XINPUT
+#endif
+        || settings.profile >= REMAP_PROFILES
+        || settings.latch >= NUM_LATCH_MODES)
+    {
+        memcpy_P(&settings, &default_settings, sizeof(settings_t));
+    }
+}
+
+
+void settings_save(void)
+{
+    /* Only rewrites bytes that changed, to spare the EEPROM */
+    eeprom_update_block(&settings, &eeprom_settings, sizeof(settings_t));
+}
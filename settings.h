@@ -0,0 +1,72 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef settings_h__
+#define settings_h__
+
+#include <stdint.h>
+
+/** Layout version of the settings block. Bump this whenever the
+ * structure below changes, so stale EEPROM contents are discarded. */
+#define SETTINGS_VERSION 4
+
+/** Default gamepad endpoint poll interval, in ms (USB frames) */
+#ifndef GAMEPAD_INTERVAL
+#define GAMEPAD_INTERVAL 10
+#endif
+
+/** Poll interval used for the high-rate (1000 Hz) mode */
+#define GAMEPAD_INTERVAL_FAST 1
+
+/** Number of button remapping profiles */
+#define REMAP_PROFILES 4
+
+/** Genesis buttons that can be remapped: A, B, C, Start, X, Y, Z and
+ * Mode, in the order of their bits in genesis_buttons */
+#define REMAP_BUTTONS 8
+
+/** Converter settings that persist across power cycles */
+typedef struct {
+    uint8_t version;
+    
+    /** bInterval reported for the gamepad endpoint */
+    uint8_t poll_interval;
+    
+    /** USB personality (enum usb_personality) presented to the host */
+    uint8_t personality;
+    
+    /** Remapping profile in use */
+    uint8_t profile;
+    
+    /** HID button number (1 to GAMEPAD_NUM_BUTTONS, or 0 for none)
+     * reported for each remappable Genesis button, per profile */
+    uint8_t remap[REMAP_PROFILES][REMAP_BUTTONS];
+    
+    /** Press latching policy between reports (LATCH_* in latch.h) */
+    uint8_t latch;
+} settings_t;
+
+/** Current settings, valid after settings_load() */
+extern settings_t settings;
+
+/** Load the settings from EEPROM, falling back to the defaults if
+ * EEPROM is blank or was written by an incompatible firmware */
+void settings_load(void);
+
+/** Write the current settings back to EEPROM */
+void settings_save(void);
+
+#endif
@@ -0,0 +1,29 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef avr_interrupt_h__
+#define avr_interrupt_h__
+
+/* Host stand-in for <avr/interrupt.h>. Nothing interrupts the host
+ * build, so handlers are plain functions a test may call itself. */
+
+#define ISR(vector, ...)        void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) {}
+
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,81 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef avr_io_h__
+#define avr_io_h__
+
+/* Host stand-in for <avr/io.h>. The pad ports are behind pad_hal.h,
+ * which the host build swaps for the pad models, so only timer 1 is
+ * needed for them; it reads the virtual clock (see host.h).
+ *
+ * The ATmega32U4's USB controller registers are plain variables (in
+ * host.c), for compiling usb_gamepad.c on the host. Nothing drives
+ * them, but the endpoint FIFO, UEDATX, keeps every byte written to it
+ * in host_usb_fifo, and reads back from there in turn. */
+
+#include <stdint.h>
+
+uint16_t host_timer1(void);
+
+#define TCNT1 host_timer1()
+
+/** Size of the endpoint FIFO stand-in, enough for any one packet */
+#define HOST_USB_FIFO_SIZE 64
+
+/** Bytes written through UEDATX since host_usb_fifo_pos was last
+ * reset, and the position of the next byte written or read */
+extern uint8_t host_usb_fifo[HOST_USB_FIFO_SIZE];
+extern uint8_t host_usb_fifo_pos;
+
+uint8_t *host_usb_fifo_next(void);
+
+#define UEDATX (*host_usb_fifo_next())
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t UHWCON, USBCON, PLLCSR;
+extern volatile uint8_t UDCON, UDINT, UDIEN, UDADDR, UDFNUML, UDFNUMH;
+extern volatile uint8_t UENUM, UERST, UECONX, UECFG0X, UECFG1X;
+extern volatile uint8_t UEINTX, UEIENX, UEINT;
+
+/* Register bits, as on the ATmega32U4 */
+#define PLOCK       0
+#define PLLE        1
+#define OTGPADE     4
+#define FRZCLK      5
+#define USBE        7
+#define RMWKUP      1
+#define SUSPI       0
+#define SOFI        2
+#define EORSTI      3
+#define WAKEUPI     4
+#define SUSPE       0
+#define SOFE        2
+#define EORSTE      3
+#define WAKEUPE     4
+#define ADDEN       7
+#define EPEN        0
+#define RSTDT       3
+#define STALLRQC    4
+#define STALLRQ     5
+#define TXINI       0
+#define RXOUTI      2
+#define RXSTPI      3
+#define RWAL        5
+#define TXINE       0
+#define RXOUTE      2
+#define RXSTPE      3
+
+#endif
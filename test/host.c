@@ -0,0 +1,81 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "host.h"
+#include "scan_sched.h"
+
+
+/** Cycles charged for reading the 16-bit timer */
+#define TIMER_READ_CYCLES 4
+
+/** Cycles per timer tick (timer 1 runs at clk/8) */
+#define CYCLES_PER_TICK 8
+
+
+uint64_t host_cycles = 0;
+
+uint8_t host_usb_fifo[HOST_USB_FIFO_SIZE];
+uint8_t host_usb_fifo_pos = 0;
+
+volatile uint8_t SREG;
+volatile uint8_t UHWCON, USBCON, PLLCSR;
+volatile uint8_t UDCON, UDINT, UDIEN, UDADDR, UDFNUML, UDFNUMH;
+volatile uint8_t UENUM, UERST, UECONX, UECFG0X, UECFG1X;
+volatile uint8_t UEINTX, UEIENX, UEINT;
+
+
+uint16_t host_timer1(void)
+{
+    host_cycles += TIMER_READ_CYCLES;
+    return (uint16_t)(host_cycles / CYCLES_PER_TICK);
+}
+
+
+uint8_t *host_usb_fifo_next(void)
+{
+    /* Past the end, the last byte is reused rather than overrun */
+    if (host_usb_fifo_pos < HOST_USB_FIFO_SIZE)
+        return &host_usb_fifo[host_usb_fifo_pos++];
+    return &host_usb_fifo[HOST_USB_FIFO_SIZE - 1];
+}
+
+
+void _delay_us(double us)
+{
+    host_cycles += (uint64_t)(us * HOST_CYCLES_PER_US);
+}
+
+
+void _delay_ms(double ms)
+{
+    _delay_us(ms * 1000);
+}
+
+
+void _delay_loop_2(uint16_t count)
+{
+    host_cycles += 4 * (uint64_t)count;
+}
+
+
+void sched_clear_of_sof(uint16_t ticks)
+{
+    /* No USB frames arrive in the host build */
+    (void)ticks;
+}
@@ -0,0 +1,49 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef host_h__
+#define host_h__
+
+/* Virtual clock for the host build. Firmware time only passes where
+ * the firmware would spend it on the AVR: in delays, timer reads and
+ * pad port accesses, each charged roughly its cost in cycles. So
+ * busy-wait loops still time out, and the pad models see select
+ * edges at realistic intervals, however fast the host runs. */
+
+#include <stdint.h>
+
+/** CPU cycles per microsecond at F_CPU */
+#define HOST_CYCLES_PER_US (F_CPU / 1000000UL)
+
+/** CPU cycles since the host build started */
+extern uint64_t host_cycles;
+
+/** Let time pass outside the firmware, e.g. between scans
+ *
+ * \param us Time to pass, in microseconds
+ */
+static inline void host_advance_us(uint32_t us)
+{
+    host_cycles += (uint64_t)us * HOST_CYCLES_PER_US;
+}
+
+/** Time since the host build started, in microseconds */
+static inline uint64_t host_now_us(void)
+{
+    return host_cycles / HOST_CYCLES_PER_US;
+}
+
+#endif
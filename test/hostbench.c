@@ -0,0 +1,107 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Benchmark of genesis_load() in the host build. For each pad type,
+ * runs a stream of 1ms scans with changing buttons and reports both
+ * how fast the host gets through them (for profiling the decode logic
+ * with host tools) and what each scan costs in virtual AVR time and
+ * pad port accesses. The AVR figures come from the cycle charges in
+ * host.c and pad_model.c, so they track changes in the number of
+ * edges, reads and settle delays rather than exact instruction
+ * counts; the firmware's own perf counters give those. */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "genesis_pad.h"
+#include "pad_model.h"
+#include "host.h"
+
+#define BENCH_SCANS 200000UL
+
+static const struct {
+    const char *name;
+    enum model_type type;
+} pads[] = {
+    { "none", MODEL_NONE },
+    { "1/2 button", MODEL_TWO_BUTTON },
+    { "3-button", MODEL_THREE_BUTTON },
+    { "6-button", MODEL_SIX_BUTTON },
+};
+
+
+static double host_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(void)
+{
+    uint64_t next_scan, start, busy;
+    uint32_t rng = 1, i;
+    uint16_t held;
+    double wall;
+    uint8_t n;
+
+    printf("%-12s %12s %10s %8s %8s %10s\n", "pad", "scans/s",
+        "ns/scan", "reads", "edges", "avr us");
+
+    for (n = 0; n < sizeof(pads) / sizeof(pads[0]); n++)
+    {
+        model_reset();
+        model_plug(0, pads[n].type);
+        genesis_init();
+        model_stats.reads = 0;
+        model_stats.edges = 0;
+        next_scan = host_cycles;
+        busy = 0;
+
+        wall = host_seconds();
+        for (i = 0; i < BENCH_SCANS; i++)
+        {
+            rng = rng * 1103515245 + 12345;
+            held = (rng >> 12) & 0xFFF;
+
+            /* No opposite directions, which a pad can't press */
+            if (held & GEN_BIT(GEN_UP))
+                held &= ~GEN_BIT(GEN_DOWN);
+            if (held & GEN_BIT(GEN_LEFT))
+                held &= ~GEN_BIT(GEN_RIGHT);
+            model_hold(0, held);
+
+            if (host_cycles < next_scan)
+                host_cycles = next_scan;
+            start = host_cycles;
+            genesis_load();
+            genesis_calibrate_next();
+            busy += host_cycles - start;
+            next_scan = start + 1000 * HOST_CYCLES_PER_US;
+        }
+        wall = host_seconds() - wall;
+
+        printf("%-12s %12.0f %10.1f %8.2f %8.2f %10.2f\n", pads[n].name,
+            BENCH_SCANS / wall, wall * 1e9 / BENCH_SCANS,
+            (double)model_stats.reads / BENCH_SCANS,
+            (double)model_stats.edges / BENCH_SCANS,
+            (double)busy / HOST_CYCLES_PER_US / BENCH_SCANS);
+    }
+    return 0;
+}
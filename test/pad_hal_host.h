@@ -0,0 +1,60 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef pad_hal_host_h__
+#define pad_hal_host_h__
+
+/* Pad port access for the host build, in place of pad_hal.h. The
+ * same calls go to the pad models in pad_model.c instead of the port
+ * registers, with values in the same common pin layout. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Number of Genesis ports to scan */
+#ifndef GENESIS_NUM_PORTS
+#define GENESIS_NUM_PORTS 1
+#endif
+
+/** The models only cover the pads themselves, not the multitaps'
+ * extra wiring */
+#ifdef GENESIS_EA_4WAY
+#error "The host build has no model of the EA 4-Way Play"
+#endif
+
+#define PAD_SELECT_PIN 5
+#define PAD_PORT_BIT(port) (1 << (port))
+#define PAD_ALL_PORTS ((1 << GENESIS_NUM_PORTS) - 1)
+#define PAD_DATA_MASK 0x5F
+#define PAD_TR_PIN 4
+#define PAD_TL_PIN 6
+
+void pad_port_init(void);
+
+uint8_t pad_read(uint8_t port);
+
+void pad_read_pressed(uint8_t pressed[]);
+
+void pad_wake_enable(void);
+void pad_wake_disable(void);
+
+void pad_tr_high(void);
+void pad_tr_low(void);
+
+void pad_select_high(uint8_t ports);
+void pad_select_low(uint8_t ports);
+
+#endif
@@ -0,0 +1,223 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "pad_hal.h"
+#include "genesis_pad.h"
+#include "pad_model.h"
+#include "host.h"
+
+
+/** Cycles charged for a port read (in), and for a select or TR change
+ * (sbi/cbi) */
+#define READ_CYCLES 1
+#define WRITE_CYCLES 2
+
+/** MODEL_SIX_TIMEOUT_US in cycles */
+#define SIX_TIMEOUT_CYCLES \
+    ((uint64_t)MODEL_SIX_TIMEOUT_US * HOST_CYCLES_PER_US)
+
+/** Pin grounded for a held button */
+#define PIN(n, button) (held & GEN_BIT(button) ? 1 << (n) : 0)
+
+
+/** State of the pad on one port */
+struct pad_model {
+    enum model_type type;
+    uint16_t held;
+    bool select;            /**< Select level driven */
+    uint8_t count;          /**< Rising select edges since the reset */
+    uint64_t last_edge;     /**< host_cycles at the last select edge */
+};
+
+static struct pad_model pads[GENESIS_NUM_PORTS];
+
+/** Set while TR on the first port is driven low */
+static bool tr_low = false;
+
+struct model_stats model_stats;
+
+
+/** A 6-button pad's count, reset if select was left alone long
+ * enough */
+static uint8_t six_count(struct pad_model *m)
+{
+    if (host_cycles - m->last_edge >= SIX_TIMEOUT_CYCLES)
+        m->count = 0;
+    return m->count;
+}
+
+
+static void select_ports(uint8_t ports, bool high)
+{
+    struct pad_model *m;
+    uint8_t p;
+
+    for (p = 0; p < GENESIS_NUM_PORTS; p++)
+    {
+        if (!(ports & PAD_PORT_BIT(p)))
+            continue;
+        host_cycles += WRITE_CYCLES;
+        m = &pads[p];
+        if (m->select == high)
+            continue;
+        six_count(m);
+        if (high)
+            m->count++;
+        m->select = high;
+        m->last_edge = host_cycles;
+        model_stats.edges++;
+    }
+}
+
+
+/** Lines a pad grounds, in the common pin layout */
+static uint8_t grounded(struct pad_model *m)
+{
+    uint16_t held = m->held;
+    uint8_t phase, low;
+
+    switch (m->type)
+    {
+    case MODEL_TWO_BUTTON:
+        return PIN(0, GEN_RIGHT) | PIN(1, GEN_LEFT) | PIN(2, GEN_DOWN)
+            | PIN(3, GEN_UP) | PIN(4, GEN_B) | PIN(6, GEN_A);
+
+    case MODEL_THREE_BUTTON:
+    case MODEL_SIX_BUTTON:
+        phase = m->type == MODEL_SIX_BUTTON ? six_count(m) % 4 : 0;
+        if (m->select)
+        {
+            if (phase == 3)
+            {
+                return PIN(0, GEN_MODE) | PIN(1, GEN_X) | PIN(2, GEN_Y)
+                    | PIN(3, GEN_Z) | PIN(4, GEN_C) | PIN(6, GEN_B);
+            }
+            return PIN(0, GEN_RIGHT) | PIN(1, GEN_LEFT) | PIN(2, GEN_DOWN)
+                | PIN(3, GEN_UP) | PIN(4, GEN_C) | PIN(6, GEN_B);
+        }
+
+        low = PIN(4, GEN_START) | PIN(6, GEN_A);
+        if (phase == 2)
+            return low | 0x0F;
+        if (phase == 3)
+            return low;
+        return low | 0x03 | PIN(2, GEN_DOWN) | PIN(3, GEN_UP);
+
+    default:
+        return 0;
+    }
+}
+
+
+/* Model control */
+
+void model_reset(void)
+{
+    memset(pads, 0, sizeof(pads));
+    memset(&model_stats, 0, sizeof(model_stats));
+    tr_low = false;
+}
+
+
+void model_plug(uint8_t port, enum model_type type)
+{
+    bool select = pads[port].select;
+
+    memset(&pads[port], 0, sizeof(pads[port]));
+    pads[port].type = type;
+    pads[port].select = select;
+}
+
+
+void model_hold(uint8_t port, uint16_t buttons)
+{
+    pads[port].held = buttons;
+}
+
+
+/* Pad HAL */
+
+void pad_port_init(void)
+{
+    select_ports(PAD_ALL_PORTS, false);
+    tr_low = false;
+}
+
+
+uint8_t pad_read(uint8_t port)
+{
+    struct pad_model *m = &pads[port];
+    uint8_t value;
+
+    host_cycles += READ_CYCLES;
+    model_stats.reads++;
+
+    /* Pulled up unless grounded; select reads back as driven */
+    value = (~grounded(m) & PAD_DATA_MASK) | 0x80;
+    if (m->select)
+        value |= 1 << PAD_SELECT_PIN;
+    if (port == 0 && tr_low)
+        value &= ~(1 << PAD_TR_PIN);
+    return value;
+}
+
+
+void pad_read_pressed(uint8_t pressed[])
+{
+    uint8_t p;
+
+    for (p = 0; p < GENESIS_NUM_PORTS; p++)
+        pressed[p] = ~pad_read(p);
+}
+
+
+void pad_wake_enable(void)
+{
+}
+
+
+void pad_wake_disable(void)
+{
+}
+
+
+void pad_tr_high(void)
+{
+    host_cycles += WRITE_CYCLES;
+    tr_low = false;
+}
+
+
+void pad_tr_low(void)
+{
+    host_cycles += WRITE_CYCLES;
+    tr_low = true;
+}
+
+
+void pad_select_high(uint8_t ports)
+{
+    select_ports(ports, true);
+}
+
+
+void pad_select_low(uint8_t ports)
+{
+    select_ports(ports, false);
+}
@@ -0,0 +1,78 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef pad_model_h__
+#define pad_model_h__
+
+/* Behavioural models of the pads on each port, behind the host
+ * build's pad HAL (pad_hal_host.h). Lines respond to select at once;
+ * what each pad drives on them is:
+ *
+ *  - 1/2 button pad: ignores select, with button 1 on TL and button 2
+ *    on TR.
+ *  - 3-button pad: the directions, B and C with select high, and Up,
+ *    Down, A and Start, with Left and Right grounded, with select low.
+ *  - 6-button pad: the same, but counting rising select edges. After
+ *    the second, select low grounds all four directions; after the
+ *    third, select high gives X, Y, Z and Mode, and select low none of
+ *    the directions. The count resets once select has been left
+ *    alone for MODEL_SIX_TIMEOUT_US. Pulsing on past the sequence
+ *    wraps around to its start, so a read taken before the count has
+ *    reset comes back wrong, and the tests catch it.
+ *
+ * Each pad holds whatever Genesis buttons (GEN_BIT()s) it is given;
+ * buttons a pad lacks are simply never seen. */
+
+#include <stdint.h>
+
+/** Time without select edges after which a 6-button pad's count
+ * resets */
+#define MODEL_SIX_TIMEOUT_US 1500
+
+enum model_type {
+    MODEL_NONE = 0,
+    MODEL_TWO_BUTTON,
+    MODEL_THREE_BUTTON,
+    MODEL_SIX_BUTTON
+};
+
+/** Port accesses made through the HAL, for the benchmark */
+struct model_stats {
+    uint32_t reads;         /**< Port reads */
+    uint32_t edges;         /**< Select level changes, per port */
+};
+
+extern struct model_stats model_stats;
+
+/** Unplug every pad and clear the statistics */
+void model_reset(void);
+
+/** Plug a pad into a port, replacing any there. It starts with no
+ * buttons held and its count reset, as when powered up.
+ *
+ * \param port Pad port
+ * \param type Pad to plug in, or MODEL_NONE to leave it empty
+ */
+void model_plug(uint8_t port, enum model_type type);
+
+/** Set the buttons held on a port's pad
+ *
+ * \param port Pad port
+ * \param buttons Held buttons, one GEN_BIT() each
+ */
+void model_hold(uint8_t port, uint16_t buttons);
+
+#endif
@@ -0,0 +1,458 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Cycle-exact benchmark of the whole firmware under simavr. Runs a
+ * genconv.elf built with PROBE=1 on a simulated ATmega32U4, with a
+ * 6-button pad model (pad_model.c) on port B following the select
+ * line, and a stub USB host that configures the device and then
+ * collects interrupt-IN reports at a fixed interval.
+ *
+ * Every probe pulse (see probe.h) and every interrupt is timed in CPU
+ * cycles and printed as a CSV row of event, start cycle and length.
+ * Each scripted button change is also timed to the first report that
+ * differs from the one before it, as "latency" rows. With -j, only
+ * a JSON summary (count, min, mean and max per event) is printed.
+ *
+ * simavr doesn't send start-of-frame interrupts, so the firmware's
+ * scan scheduler stays in its free-running one scan per frame mode;
+ * scan and interrupt lengths are unaffected.
+ *
+ * Usage: simbench [-j] [-t ms] [-p us] genconv.elf
+ *   -j  print a JSON summary instead of CSV rows
+ *   -t  simulated time to run for, in milliseconds (default 2000)
+ *   -p  host poll interval, in microseconds (default 1000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_usb.h>
+
+#include "genesis_pad.h"
+#include "pad_hal.h"
+#include "pad_model.h"
+#include "host.h"
+
+#define MCU_NAME "atmega32u4"
+
+/** Probe pins on port F (probe.h), from PROBE_SCAN up */
+#define PROBE_FIRST_PIN 4
+#define NUM_PROBES 4
+
+/** Interrupt vectors timed */
+#define NUM_VECTORS 43
+
+/** Time between scripted button changes. Not a whole number of
+ * frames, so the changes land at every point of the scan cycle. */
+#define SCRIPT_PERIOD_US 7300
+
+/** Polls allowed for the status stage of SET_CONFIGURATION */
+#define STATUS_TRIES 20
+
+/** Statistics for one kind of event */
+struct event_stats {
+    const char *name;
+    uint64_t count, total, min, max;
+};
+
+enum {
+    EV_SCAN = 0,
+    EV_PUBLISH,
+    EV_REPORT,
+    EV_USB_ISR,
+    EV_LATENCY,
+    EV_VECTOR
+};
+
+static struct event_stats stats[EV_VECTOR + NUM_VECTORS] = {
+    [EV_SCAN] = { .name = "scan" },
+    [EV_PUBLISH] = { .name = "publish" },
+    [EV_REPORT] = { .name = "report" },
+    [EV_USB_ISR] = { .name = "usb_isr" },
+    [EV_LATENCY] = { .name = "latency" },
+    [EV_VECTOR + 9] = { .name = "PCINT0_vect" },
+    [EV_VECTOR + 10] = { .name = "USB_GEN_vect" },
+    [EV_VECTOR + 11] = { .name = "USB_COM_vect" },
+    [EV_VECTOR + 17] = { .name = "TIMER1_COMPA_vect" },
+};
+
+/** Cycle each running event started at */
+static uint64_t started[EV_VECTOR + NUM_VECTORS];
+
+static avr_t *avr;
+static avr_irq_t *pad_pins;
+static bool json = false;
+
+/** Stub host state */
+static enum {
+    HOST_WAIT_ATTACH,
+    HOST_CONFIGURE,
+    HOST_STATUS,
+    HOST_POLL
+} host_state = HOST_WAIT_ATTACH;
+
+static bool attached = false;
+static uint8_t status_tries = 0;
+static uint32_t poll_us = 1000;
+
+static uint8_t last_report[64];
+static uint32_t last_report_size = 0;
+
+/** Cycle of the last button change not yet seen in a report, or 0 */
+static uint64_t change_cycle = 0;
+
+
+static void record(uint8_t event, uint64_t start, uint64_t cycles)
+{
+    struct event_stats *s = &stats[event];
+    char name[16];
+
+    if (!s->name)
+    {
+        snprintf(name, sizeof(name), "vector%u", event - EV_VECTOR);
+        s->name = strdup(name);
+    }
+    if (!s->count || cycles < s->min)
+        s->min = cycles;
+    if (cycles > s->max)
+        s->max = cycles;
+    s->total += cycles;
+    s->count++;
+
+    if (!json)
+    {
+        printf("%s,%llu,%llu\n", s->name, (unsigned long long)start,
+            (unsigned long long)cycles);
+    }
+}
+
+
+/** Start or end an event as its line rises or falls */
+static void event_edge(uint8_t event, uint32_t value)
+{
+    if (value)
+        started[event] = avr->cycle;
+    else if (started[event])
+        record(event, started[event], avr->cycle - started[event]);
+}
+
+
+static void probe_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    event_edge((uint8_t)(intptr_t)param, value);
+}
+
+
+static void vector_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    event_edge(EV_VECTOR + (uint8_t)(intptr_t)param, value);
+}
+
+
+/** Bring the pad model's clock up to the simulation's. It only ever
+ * moves forward, as the model charges a few cycles of its own. */
+static void sync_model(void)
+{
+    if (avr->cycle > host_cycles)
+        host_cycles = avr->cycle;
+}
+
+
+/** Drive the port B data pins as the pad model says */
+static void drive_pad(void)
+{
+    uint8_t value, pin;
+
+    sync_model();
+    value = pad_read(0);
+    for (pin = 0; pin < 8; pin++)
+    {
+        if (PAD_DATA_MASK & (1 << pin))
+            avr_raise_irq(pad_pins + pin, (value >> pin) & 1);
+    }
+}
+
+
+/** Refresh the pins once a 6-button pad's counter has timed out */
+static avr_cycle_count_t pad_timeout(avr_t *a, avr_cycle_count_t when,
+    void *param)
+{
+    (void)a;
+    (void)when;
+    (void)param;
+    drive_pad();
+    return 0;
+}
+
+
+static void select_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)param;
+
+    sync_model();
+    if (value)
+        pad_select_high(PAD_PORT_BIT(0));
+    else
+        pad_select_low(PAD_PORT_BIT(0));
+    drive_pad();
+    avr_cycle_timer_register_usec(avr, MODEL_SIX_TIMEOUT_US + 1,
+        pad_timeout, NULL);
+}
+
+
+/** Step through a fixed sequence of held buttons */
+static avr_cycle_count_t script_step(avr_t *a, avr_cycle_count_t when,
+    void *param)
+{
+    static const uint16_t script[] = {
+        GEN_BIT(GEN_A), 0, GEN_BIT(GEN_B) | GEN_BIT(GEN_RIGHT), 0,
+        GEN_BIT(GEN_X), GEN_BIT(GEN_X) | GEN_BIT(GEN_START), 0,
+        GEN_BIT(GEN_UP) | GEN_BIT(GEN_C), GEN_BIT(GEN_MODE), 0 };
+    static uint8_t step = 0;
+
+    (void)param;
+    model_hold(0, script[step]);
+    step = (step + 1) % (sizeof(script) / sizeof(script[0]));
+    drive_pad();
+    change_cycle = a->cycle;
+    return when + avr_usec_to_cycles(a, SCRIPT_PERIOD_US);
+}
+
+
+static void attach_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)param;
+    attached = value;
+}
+
+
+static void got_report(const uint8_t *buf, uint32_t size)
+{
+    bool differs = size != last_report_size
+        || memcmp(buf, last_report, size);
+
+    if (differs && change_cycle && last_report_size)
+    {
+        record(EV_LATENCY, change_cycle, avr->cycle - change_cycle);
+        change_cycle = 0;
+    }
+    memcpy(last_report, buf, size);
+    last_report_size = size;
+}
+
+
+/** One step of the stub host, once per poll interval */
+static avr_cycle_count_t host_step(avr_t *a, avr_cycle_count_t when,
+    void *param)
+{
+    /* SET_CONFIGURATION 1 */
+    static const uint8_t set_config[8] = { 0x00, 0x09, 1, 0, 0, 0, 0, 0 };
+    uint8_t buf[64];
+    struct avr_io_usb pkt = { .buf = buf };
+
+    (void)param;
+    switch (host_state)
+    {
+    case HOST_WAIT_ATTACH:
+        if (attached)
+        {
+            avr_ioctl(a, AVR_IOCTL_USB_RESET, NULL);
+            host_state = HOST_CONFIGURE;
+        }
+        break;
+
+    case HOST_CONFIGURE:
+        memcpy(buf, set_config, sizeof(set_config));
+        pkt.pipe = 0;
+        pkt.sz = sizeof(set_config);
+        if (avr_ioctl(a, AVR_IOCTL_USB_SETUP, &pkt) >= 0)
+            host_state = HOST_STATUS;
+        break;
+
+    case HOST_STATUS:
+        /* Collect the zero-length status packet */
+        pkt.pipe = 0x80;
+        pkt.sz = sizeof(buf);
+        if (avr_ioctl(a, AVR_IOCTL_USB_READ, &pkt) == AVR_IOCTL_USB_OK
+            || ++status_tries >= STATUS_TRIES)
+        {
+            host_state = HOST_POLL;
+        }
+        break;
+
+    case HOST_POLL:
+        pkt.pipe = 0x81;
+        pkt.sz = sizeof(buf);
+        if (avr_ioctl(a, AVR_IOCTL_USB_READ, &pkt) == AVR_IOCTL_USB_OK
+            && pkt.sz)
+        {
+            got_report(buf, pkt.sz);
+        }
+        break;
+    }
+    return when + avr_usec_to_cycles(a, poll_us);
+}
+
+
+static void print_json(void)
+{
+    const struct event_stats *s;
+    bool first = true;
+    unsigned i;
+
+    printf("{\"mcu\": \"%s\", \"frequency\": %u, \"events\": {",
+        MCU_NAME, (unsigned)avr->frequency);
+    for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++)
+    {
+        s = &stats[i];
+        if (!s->count)
+            continue;
+        printf("%s\n  \"%s\": {\"count\": %llu, \"min\": %llu, "
+            "\"mean\": %.1f, \"max\": %llu}", first ? "" : ",", s->name,
+            (unsigned long long)s->count, (unsigned long long)s->min,
+            (double)s->total / s->count, (unsigned long long)s->max);
+        first = false;
+    }
+    printf("\n}}\n");
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-j] [-t ms] [-p us] genconv.elf\n", name);
+    exit(2);
+}
+
+
+int main(int argc, char *argv[])
+{
+    elf_firmware_t firmware;
+    avr_irq_t *irq;
+    uint32_t run_ms = 2000;
+    uint64_t end;
+    unsigned i;
+    int opt, state;
+
+    while ((opt = getopt(argc, argv, "jt:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            json = true;
+            break;
+        case 't':
+            run_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            poll_us = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || !poll_us)
+        usage(argv[0]);
+
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[optind], &firmware))
+    {
+        fprintf(stderr, "Can't read %s\n", argv[optind]);
+        return 1;
+    }
+    if (!firmware.frequency)
+        firmware.frequency = F_CPU;
+
+    avr = avr_make_mcu_by_name(MCU_NAME);
+    if (!avr)
+    {
+        fprintf(stderr, "simavr has no %s core\n", MCU_NAME);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    /* The pad, on port B */
+    model_reset();
+    model_plug(0, MODEL_SIX_BUTTON);
+    pad_pins = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0);
+    avr_irq_register_notify(pad_pins + PAD_SELECT_PIN, select_notify, NULL);
+    drive_pad();
+    avr_cycle_timer_register_usec(avr, SCRIPT_PERIOD_US, script_step, NULL);
+
+    /* Probes and interrupts */
+    for (i = 0; i < NUM_PROBES; i++)
+    {
+        irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'),
+            PROBE_FIRST_PIN + i);
+        avr_irq_register_notify(irq, probe_notify, (void *)(intptr_t)i);
+    }
+    for (i = 1; i < NUM_VECTORS; i++)
+    {
+        irq = avr_get_interrupt_irq(avr, i);
+        if (irq)
+        {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING,
+                vector_notify, (void *)(intptr_t)i);
+        }
+    }
+
+    /* The stub host */
+    irq = avr_io_getirq(avr, AVR_IOCTL_USB_GETIRQ(), USB_IRQ_ATTACH);
+    if (irq)
+    {
+        avr_irq_register_notify(irq, attach_notify, NULL);
+        avr_ioctl(avr, AVR_IOCTL_USB_VBUS, (void *)1);
+        avr_cycle_timer_register_usec(avr, poll_us, host_step, NULL);
+    }
+    else
+    {
+        fprintf(stderr, "No USB in this simavr; running without a host\n");
+    }
+
+    if (!json)
+        printf("event,start,cycles\n");
+
+    end = avr_usec_to_cycles(avr, (uint64_t)run_ms * 1000);
+    do
+    {
+        state = avr_run(avr);
+    } while (avr->cycle < end && state != cpu_Done && state != cpu_Crashed);
+
+    if (state == cpu_Crashed)
+        fprintf(stderr, "Firmware crashed at cycle %llu\n",
+            (unsigned long long)avr->cycle);
+    if (host_state != HOST_POLL)
+        fprintf(stderr, "The host never got to polling for reports\n");
+
+    if (json)
+        print_json();
+    return state == cpu_Crashed;
+}
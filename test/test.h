@@ -0,0 +1,64 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef test_h__
+#define test_h__
+
+/* A minimal test harness for the host build. Each test is a plain
+ * function run with RUN(); failed checks are printed with their line
+ * and counted, and TEST_SUMMARY() gives the exit status. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+static unsigned test_checks = 0, test_failures = 0;
+
+/** Check that a condition holds */
+#define CHECK(cond) do { \
+    test_checks++; \
+    if (!(cond)) \
+    { \
+        test_failures++; \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+/** Check that two integer values are equal, printing both if not */
+#define CHECK_EQ(actual, expected) do { \
+    long long actual__ = (actual), expected__ = (expected); \
+    test_checks++; \
+    if (actual__ != expected__) \
+    { \
+        test_failures++; \
+        printf("%s:%d: %s is 0x%llX, expected 0x%llX\n", __FILE__, \
+            __LINE__, #actual, actual__, expected__); \
+    } \
+} while (0)
+
+/** Run one test function */
+#define RUN(test) do { \
+    unsigned failures__ = test_failures; \
+    test(); \
+    printf("%-40s %s\n", #test, \
+        test_failures == failures__ ? "ok" : "FAILED"); \
+} while (0)
+
+/** Print the totals, giving the exit status for main() */
+#define TEST_SUMMARY() \
+    (printf("%u checks, %u failed\n", test_checks, test_failures), \
+     test_failures ? 1 : 0)
+
+#endif
@@ -0,0 +1,153 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tests of debounce.c, in whichever DEBOUNCE_MODE it is built for */
+
+#include "debounce.h"
+#include "test.h"
+
+#define A GEN_BIT(GEN_A)
+#define B GEN_BIT(GEN_B)
+
+
+/** Feed one pad a sequence of samples, checking each output */
+static void feed(uint8_t pad, const uint16_t raw[], const uint16_t out[],
+    uint8_t n)
+{
+    uint8_t i;
+
+    for (i = 0; i < n; i++)
+        CHECK_EQ(debounce_filter(pad, raw[i]), out[i]);
+}
+
+
+#if DEBOUNCE_MODE == DEBOUNCE_EAGER
+
+static void test_press(void)
+{
+    /* Presses pass straight through; releases wait for the count */
+    static const uint16_t raw[] = { A, A | B, B, 0, 0 };
+    static const uint16_t out[] = { A, A | B, A | B, B, 0 };
+
+    feed(0, raw, out, sizeof(raw) / sizeof(raw[0]));
+}
+
+static void test_bounce(void)
+{
+    /* A release that doesn't last is a bounce, and is counted */
+    static const uint16_t raw[] = { A, 0, A, 0, A, 0, 0 };
+    static const uint16_t out[] = { A, A, A, A, A, A, 0 };
+
+    debounce_chatter[0][GEN_A] = 0;
+    feed(0, raw, out, sizeof(raw) / sizeof(raw[0]));
+    CHECK_EQ(debounce_chatter[0][GEN_A], 2);
+    CHECK_EQ(debounce_chatter[0][GEN_B], 0);
+}
+
+#else
+
+static void test_press(void)
+{
+    /* Presses and releases both wait for the count */
+    static const uint16_t raw[] = { A, A, A | B, A | B, B, B, 0, 0 };
+    static const uint16_t out[] = { 0, A, A, A | B, A | B, B, B, 0 };
+
+    feed(0, raw, out, sizeof(raw) / sizeof(raw[0]));
+}
+
+static void test_bounce(void)
+{
+    /* A change that doesn't last is a bounce, either way */
+    static const uint16_t raw[] = { A, 0, A, A, 0, A, 0, 0 };
+    static const uint16_t out[] = { 0, 0, 0, A, A, A, A, 0 };
+
+    debounce_chatter[0][GEN_A] = 0;
+    feed(0, raw, out, sizeof(raw) / sizeof(raw[0]));
+    CHECK_EQ(debounce_chatter[0][GEN_A], 2);
+}
+
+#endif
+
+
+#if DEBOUNCE_MODE == DEBOUNCE_EAGER
+
+static void test_hold(void)
+{
+    /* Samples between reports show presses at once, but don't count
+     * towards a release or as bounces */
+    debounce_chatter[1][GEN_A] = 0;
+    CHECK_EQ(debounce_hold(1, A), A);
+    CHECK_EQ(debounce_filter(1, 0), 0);
+    CHECK_EQ(debounce_filter(1, A), A);
+    CHECK_EQ(debounce_hold(1, 0), A);
+    CHECK_EQ(debounce_filter(1, 0), A);
+    CHECK_EQ(debounce_hold(1, A), A);
+    CHECK_EQ(debounce_hold(1, 0), A);
+    CHECK_EQ(debounce_filter(1, 0), 0);
+    CHECK_EQ(debounce_chatter[1][GEN_A], 0);
+}
+
+#else
+
+static void test_hold(void)
+{
+    debounce_chatter[1][GEN_A] = 0;
+    CHECK_EQ(debounce_hold(1, A), 0);
+    CHECK_EQ(debounce_filter(1, A), 0);
+    CHECK_EQ(debounce_hold(1, 0), 0);
+    CHECK_EQ(debounce_filter(1, A), A);
+    CHECK_EQ(debounce_hold(1, 0), A);
+    CHECK_EQ(debounce_chatter[1][GEN_A], 0);
+}
+
+#endif
+
+
+static void test_clear(void)
+{
+    debounce_chatter[0][GEN_A] = 3;
+    debounce_chatter[0][GEN_MODE] = 4;
+    debounce_clear_chatter(0);
+    CHECK_EQ(debounce_chatter[0][GEN_A], 0);
+    CHECK_EQ(debounce_chatter[0][GEN_MODE], 0);
+}
+
+
+static void test_saturate(void)
+{
+    uint16_t i;
+
+    debounce_chatter[0][GEN_B] = 0;
+    debounce_filter(0, B);
+    debounce_filter(0, B);
+    for (i = 0; i < 600; i++)
+        debounce_filter(0, i & 1 ? B : 0);
+    CHECK_EQ(debounce_chatter[0][GEN_B], 0xFF);
+}
+
+
+int main(void)
+{
+    printf("debounce, mode %d, %d samples\n", DEBOUNCE_MODE,
+        DEBOUNCE_SAMPLES);
+    RUN(test_press);
+    RUN(test_bounce);
+    RUN(test_hold);
+    RUN(test_clear);
+    RUN(test_saturate);
+    return TEST_SUMMARY();
+}
@@ -0,0 +1,446 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tests of genesis_pad.c against the pad models in pad_model.c. Scans
+ * are paced in virtual time as the scan scheduler would pace them, so
+ * the 6-button pad's counter sees the same select edge timing as on
+ * the AVR. Build with GENESIS_NUM_PORTS=2 to cover a second port. */
+
+#include "genesis_pad.h"
+#include "perf.h"
+#include "pad_model.h"
+#include "host.h"
+#include "test.h"
+
+/** Buttons each pad type has */
+#define TWO_BUTTONS (GEN_DIRECTION_BITS | GEN_BIT(GEN_A) | GEN_BIT(GEN_B))
+#define THREE_BUTTONS (GEN_DIRECTION_BITS | GEN_BIT(GEN_A) \
+    | GEN_BIT(GEN_B) | GEN_BIT(GEN_C) | GEN_BIT(GEN_START))
+#define SIX_BUTTONS (THREE_BUTTONS | GEN_BIT(GEN_X) | GEN_BIT(GEN_Y) \
+    | GEN_BIT(GEN_Z) | GEN_BIT(GEN_MODE))
+
+/** Buttons a 6-button pad still reports while its counter runs */
+#define HELD_BUTTONS (GEN_BIT(GEN_A) | GEN_BIT(GEN_START))
+
+/** Longest a scan (with any calibration after it) may take */
+#define SCAN_LIMIT_US 1000
+
+/** Virtual time the next scan is due */
+static uint64_t next_scan;
+
+static uint32_t rng = 1;
+
+
+/** Pseudo-random button bits, the same on every run */
+static uint16_t random_buttons(uint16_t mask)
+{
+    uint16_t buttons;
+
+    rng = rng * 1103515245 + 12345;
+    buttons = (rng >> 12) & mask;
+
+    /* A pad can't press opposite directions together, and Up and
+     * Down would look like a 6-button pad's handshake to a 3-button
+     * pad's detection */
+    if (buttons & GEN_BIT(GEN_UP))
+        buttons &= ~GEN_BIT(GEN_DOWN);
+    if (buttons & GEN_BIT(GEN_LEFT))
+        buttons &= ~GEN_BIT(GEN_RIGHT);
+    return buttons;
+}
+
+
+/** Plug in the pads and start up as at power-up */
+static void setup(enum model_type port0, enum model_type port1)
+{
+    model_reset();
+    model_plug(0, port0);
+#if GENESIS_NUM_PORTS >= 2
+    model_plug(1, port1);
+#else
+    (void)port1;
+#endif
+    genesis_init();
+    next_scan = host_cycles;
+}
+
+
+/** Run one scan once it is due, as the main loop would, and schedule
+ * the next one
+ *
+ * \param interval_us Time from the start of this scan to the next
+ * \return Time the scan took, in microseconds
+ */
+static uint32_t scan(uint32_t interval_us)
+{
+    uint64_t start;
+
+    if (host_cycles < next_scan)
+        host_cycles = next_scan;
+    start = host_cycles;
+    genesis_load();
+    genesis_calibrate_next();
+    next_scan = start + (uint64_t)interval_us * HOST_CYCLES_PER_US;
+    return (uint32_t)((host_cycles - start) / HOST_CYCLES_PER_US);
+}
+
+
+static void test_nothing_connected(void)
+{
+    uint8_t i;
+
+    setup(MODEL_NONE, MODEL_NONE);
+    for (i = 0; i < 5; i++)
+    {
+        CHECK(scan(1000) <= SCAN_LIMIT_US);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_NONE);
+        CHECK_EQ(genesis_buttons[0], 0);
+    }
+    CHECK_EQ(genesis_settle_us, GENESIS_SETTLE_MAX_US);
+}
+
+
+static void test_two_button(void)
+{
+    uint8_t b;
+
+    setup(MODEL_TWO_BUTTON, MODEL_NONE);
+
+    /* Nothing pressed reads as nothing connected */
+    scan(1000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_NONE);
+
+    for (b = GEN_RIGHT; b < NUM_GEN_BUTTONS; b++)
+    {
+        if (!(TWO_BUTTONS & GEN_BIT(b)))
+            continue;
+        model_hold(0, GEN_BIT(b));
+        scan(1000);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_1_2_BUTTON);
+        CHECK_EQ(genesis_buttons[0], GEN_BIT(b));
+    }
+
+    model_hold(0, GEN_BIT(GEN_UP) | GEN_BIT(GEN_RIGHT) | GEN_BIT(GEN_A)
+        | GEN_BIT(GEN_B));
+    scan(1000);
+    CHECK_EQ(genesis_buttons[0], GEN_BIT(GEN_UP) | GEN_BIT(GEN_RIGHT)
+        | GEN_BIT(GEN_A) | GEN_BIT(GEN_B));
+
+    model_hold(0, 0);
+    scan(1000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_NONE);
+    CHECK_EQ(genesis_buttons[0], 0);
+}
+
+
+static void test_three_button(void)
+{
+    uint16_t held;
+    uint8_t b, i;
+
+    setup(MODEL_THREE_BUTTON, MODEL_NONE);
+    scan(1000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_3_BUTTON);
+
+    for (b = GEN_RIGHT; b < NUM_GEN_BUTTONS; b++)
+    {
+        model_hold(0, GEN_BIT(b));
+        scan(1000);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_3_BUTTON);
+        CHECK_EQ(genesis_buttons[0], GEN_BIT(b) & THREE_BUTTONS);
+    }
+
+    /* Once known, a 3-button pad is read in full every scan */
+    for (i = 0; i < 100; i++)
+    {
+        held = random_buttons(THREE_BUTTONS);
+        model_hold(0, held);
+        CHECK(scan(1000) <= SCAN_LIMIT_US);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_3_BUTTON);
+        CHECK_EQ(genesis_buttons[0], held);
+    }
+}
+
+
+static void test_six_button(void)
+{
+    uint8_t b;
+
+    setup(MODEL_SIX_BUTTON, MODEL_NONE);
+
+    /* Calibration leaves the counter timed out, so the first scan
+     * already finds all six buttons */
+    scan(10000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+
+    for (b = GEN_RIGHT; b < NUM_GEN_BUTTONS; b++)
+    {
+        model_hold(0, GEN_BIT(b));
+        scan(10000);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+        CHECK_EQ(genesis_buttons[0], GEN_BIT(b));
+    }
+}
+
+
+/** At 1ms, only every other scan may use select edges; the ones in
+ * between still refresh A and Start */
+static void test_six_button_1ms(void)
+{
+    uint16_t held, last_held = 0;
+    uint8_t i, exact = 0, since_exact = 0;
+
+    setup(MODEL_SIX_BUTTON, MODEL_NONE);
+    scan(1000);
+
+    for (i = 0; i < 200; i++)
+    {
+        held = random_buttons(SIX_BUTTONS);
+        model_hold(0, held);
+        CHECK(scan(1000) <= SCAN_LIMIT_US);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+        CHECK_EQ(genesis_buttons[0] & HELD_BUTTONS, held & HELD_BUTTONS);
+        CHECK((genesis_buttons[0] & ~HELD_BUTTONS)
+                == (held & ~HELD_BUTTONS)
+            || (genesis_buttons[0] & ~HELD_BUTTONS)
+                == (last_held & ~HELD_BUTTONS));
+
+        if (genesis_buttons[0] == held)
+        {
+            exact++;
+            since_exact = 0;
+        }
+        else
+        {
+            CHECK(++since_exact < 2);
+        }
+        last_held = held;
+    }
+    CHECK(exact >= 100);
+}
+
+
+/** Held buttons read back exactly at any scan interval, including
+ * those either side of the pad's counter timing out. From the
+ * firmware's timeout up, every scan is a full read. */
+static void test_six_button_intervals(void)
+{
+    static const uint16_t intervals[] = {
+        1000, 1500, 1700, 1900, 2500, 10000 };
+    const uint16_t fixed = GEN_BIT(GEN_UP) | GEN_BIT(GEN_A)
+        | GEN_BIT(GEN_C) | GEN_BIT(GEN_X) | GEN_BIT(GEN_MODE);
+    uint16_t held;
+    uint8_t n, i;
+
+    for (n = 0; n < sizeof(intervals) / sizeof(intervals[0]); n++)
+    {
+        setup(MODEL_SIX_BUTTON, MODEL_NONE);
+        model_hold(0, fixed);
+        for (i = 0; i < 50; i++)
+        {
+            scan(intervals[n]);
+            CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+            CHECK_EQ(genesis_buttons[0], fixed);
+        }
+
+        if (intervals[n] < GENESIS_SIX_TIMEOUT_US + 100)
+            continue;
+        for (i = 0; i < 50; i++)
+        {
+            held = random_buttons(SIX_BUTTONS);
+            model_hold(0, held);
+            scan(intervals[n]);
+            CHECK_EQ(genesis_buttons[0], held);
+        }
+    }
+}
+
+
+/** Scan at 1ms until a port reads as the given type
+ *
+ * \return Scans it took, or 0 if it didn't within a few
+ */
+static uint8_t scan_until(uint8_t port, enum genesis_type type)
+{
+    uint8_t i;
+
+    for (i = 1; i <= 4; i++)
+    {
+        CHECK(scan(1000) <= SCAN_LIMIT_US);
+        if (genesis_pad_type[port] == type)
+            return i;
+    }
+    return 0;
+}
+
+
+static void test_hotplug(void)
+{
+    const uint16_t fixed = GEN_BIT(GEN_LEFT) | GEN_BIT(GEN_B)
+        | GEN_BIT(GEN_START) | GEN_BIT(GEN_Z);
+    uint8_t i;
+
+    setup(MODEL_NONE, MODEL_NONE);
+    for (i = 0; i < 5; i++)
+        scan(1000);
+    CHECK_EQ(genesis_settle_us, GENESIS_SETTLE_MAX_US);
+
+    /* A 6-button pad is found once its counter can be trusted, and
+     * measured straight after, between scans */
+    model_plug(0, MODEL_SIX_BUTTON);
+    model_hold(0, fixed);
+    CHECK(scan_until(0, GEN_TYPE_6_BUTTON));
+    CHECK(genesis_settle_us < GENESIS_SETTLE_MAX_US);
+    for (i = 0; i < 10; i++)
+    {
+        scan(1000);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+        CHECK_EQ(genesis_buttons[0], fixed);
+    }
+
+    model_plug(0, MODEL_NONE);
+    CHECK(scan_until(0, GEN_TYPE_NONE));
+    CHECK_EQ(genesis_buttons[0], 0);
+    CHECK_EQ(genesis_settle_us, GENESIS_SETTLE_MAX_US);
+
+    /* A 3-button pad passes for one until the probe has run, then
+     * stays one */
+    model_plug(0, MODEL_THREE_BUTTON);
+    model_hold(0, fixed & THREE_BUTTONS);
+    CHECK(scan_until(0, GEN_TYPE_3_BUTTON));
+    CHECK(genesis_settle_us < GENESIS_SETTLE_MAX_US);
+    for (i = 0; i < 10; i++)
+    {
+        scan(1000);
+        CHECK_EQ(genesis_pad_type[0], GEN_TYPE_3_BUTTON);
+    }
+    CHECK_EQ(genesis_buttons[0], fixed & THREE_BUTTONS);
+
+    model_plug(0, MODEL_NONE);
+    CHECK(scan_until(0, GEN_TYPE_NONE));
+
+    model_plug(0, MODEL_SIX_BUTTON);
+    CHECK(scan_until(0, GEN_TYPE_6_BUTTON));
+    model_hold(0, GEN_BIT(GEN_Y));
+    scan(1000);
+    scan(1000);
+    CHECK_EQ(genesis_buttons[0], GEN_BIT(GEN_Y));
+}
+
+
+static void test_perf_settle(void)
+{
+    setup(MODEL_SIX_BUTTON, MODEL_NONE);
+    scan(1000);
+    CHECK(genesis_settle_us < GENESIS_SETTLE_MAX_US);
+    CHECK_EQ(perf.settle_us, genesis_settle_us);
+
+    perf_reset();
+    CHECK_EQ(perf.settle_us, genesis_settle_us);
+
+    model_plug(0, MODEL_NONE);
+    scan_until(0, GEN_TYPE_NONE);
+    CHECK_EQ(perf.settle_us, GENESIS_SETTLE_MAX_US);
+}
+
+
+#if GENESIS_NUM_PORTS >= 2
+static void test_two_ports(void)
+{
+    uint16_t held0, held1;
+    uint8_t i;
+
+    setup(MODEL_SIX_BUTTON, MODEL_THREE_BUTTON);
+    scan(10000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+    CHECK_EQ(genesis_pad_type[1], GEN_TYPE_3_BUTTON);
+
+    for (i = 0; i < 50; i++)
+    {
+        held0 = random_buttons(SIX_BUTTONS);
+        held1 = random_buttons(THREE_BUTTONS);
+        model_hold(0, held0);
+        model_hold(1, held1);
+        scan(10000);
+        CHECK_EQ(genesis_buttons[0], held0);
+        CHECK_EQ(genesis_buttons[1], held1);
+    }
+
+    /* A 1/2 button pad on the second port doesn't disturb the first */
+    model_plug(1, MODEL_TWO_BUTTON);
+    model_hold(1, GEN_BIT(GEN_A));
+    model_hold(0, GEN_BIT(GEN_X));
+    scan(10000);
+    CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+    CHECK_EQ(genesis_pad_type[1], GEN_TYPE_1_2_BUTTON);
+    CHECK_EQ(genesis_buttons[0], GEN_BIT(GEN_X));
+    CHECK_EQ(genesis_buttons[1], GEN_BIT(GEN_A));
+}
+
+
+/** A 6-button pad's counter only holds back its own port: the pad on
+ * the other port is still read in full every 1ms scan */
+static void test_two_ports_1ms(void)
+{
+    static const enum model_type others[] = {
+        MODEL_THREE_BUTTON, MODEL_TWO_BUTTON };
+    static const uint16_t masks[] = { THREE_BUTTONS, TWO_BUTTONS };
+    uint16_t held0, held1;
+    uint8_t n, i;
+
+    for (n = 0; n < 2; n++)
+    {
+        setup(MODEL_SIX_BUTTON, others[n]);
+        model_hold(1, GEN_BIT(GEN_A));
+        scan(1000);
+
+        for (i = 0; i < 100; i++)
+        {
+            held0 = random_buttons(SIX_BUTTONS);
+            held1 = random_buttons(masks[n]) | GEN_BIT(GEN_A);
+            model_hold(0, held0);
+            model_hold(1, held1);
+            CHECK(scan(1000) <= SCAN_LIMIT_US);
+            CHECK_EQ(genesis_pad_type[0], GEN_TYPE_6_BUTTON);
+            CHECK_EQ(genesis_buttons[0] & HELD_BUTTONS,
+                held0 & HELD_BUTTONS);
+            CHECK_EQ(genesis_buttons[1], held1);
+        }
+        CHECK_EQ(genesis_pad_type[1], n ? GEN_TYPE_1_2_BUTTON
+            : GEN_TYPE_3_BUTTON);
+    }
+}
+#endif
+
+
+int main(void)
+{
+    printf("genesis_pad, %d port(s)\n", GENESIS_NUM_PORTS);
+    RUN(test_nothing_connected);
+    RUN(test_two_button);
+    RUN(test_three_button);
+    RUN(test_six_button);
+    RUN(test_six_button_1ms);
+    RUN(test_six_button_intervals);
+    RUN(test_hotplug);
+    RUN(test_perf_settle);
+#if GENESIS_NUM_PORTS >= 2
+    RUN(test_two_ports);
+    RUN(test_two_ports_1ms);
+#endif
+    return TEST_SUMMARY();
+}
@@ -0,0 +1,263 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tests of the XInput personality in usb_gamepad.c, which is compiled
+ * in here whole, against the USB register stand-ins in avr/io.h. The
+ * descriptors are checked byte for byte against what Windows' XUSB
+ * driver and Linux's xpad look for, and the report against the wired
+ * Xbox 360 pad's 20-byte layout. tools/xinputcheck.c does the same
+ * against a real converter, through libusb. */
+
+#include "../usb_gamepad.c"
+
+#include "test.h"
+
+/** Offsets into xinput_config1_descriptor */
+#define INTERFACE_OFFSET    9
+#define CLASS_DESC_OFFSET   (INTERFACE_OFFSET + 9)
+#define IN_EP_OFFSET        (CLASS_DESC_OFFSET + 17)
+#define OUT_EP_OFFSET       (IN_EP_OFFSET + 7)
+
+/** Remapping and the other settings, which settings.c keeps in
+ * EEPROM; the XInput report doesn't use them */
+settings_t settings;
+
+
+/** Run xinput_write() on a state, leaving the report in
+ * host_usb_fifo */
+static void write_report(uint16_t buttons, uint8_t x, uint8_t y)
+{
+    gamepad_state_t state;
+
+    memset(&state, 0, sizeof(state));
+    state.buttons = buttons;
+    state.xAxis = x;
+    state.yAxis = y;
+    memset(host_usb_fifo, 0xAA, sizeof(host_usb_fifo));
+    host_usb_fifo_pos = 0;
+    xinput_write(&state);
+}
+
+
+static void test_device(void)
+{
+    const uint8_t *d = xinput_device_descriptor;
+
+    CHECK_EQ(sizeof(xinput_device_descriptor), 18);
+    CHECK_EQ(d[0], 18);
+    CHECK_EQ(d[1], 1);
+    /* Vendor class is left to the interface */
+    CHECK_EQ(d[4], 0);
+    CHECK_EQ(d[10] | (d[11] << 8), XINPUT_PRODUCT_ID);
+}
+
+
+static void test_config(void)
+{
+    const uint8_t *d = xinput_config1_descriptor;
+    unsigned i, n = 0;
+
+    CHECK_EQ(d[1], 2);
+    CHECK_EQ(d[2] | (d[3] << 8), sizeof(xinput_config1_descriptor));
+    CHECK_EQ(d[4], XINPUT_INTERFACES);
+
+    /* Every descriptor's length adds up to the total */
+    for (i = 0; i < sizeof(xinput_config1_descriptor) && d[i]; i += d[i])
+        n++;
+    CHECK_EQ(i, sizeof(xinput_config1_descriptor));
+    CHECK_EQ(n, 5);
+}
+
+
+static void test_interface(void)
+{
+    const uint8_t *d = xinput_config1_descriptor + INTERFACE_OFFSET;
+
+    CHECK_EQ(d[0], 9);
+    CHECK_EQ(d[1], 4);
+    CHECK_EQ(d[2], GAMEPAD_INTERFACE);
+    CHECK_EQ(d[4], 2);
+    /* Vendor class, with the Xbox 360 pad's subclass and protocol */
+    CHECK_EQ(d[5], 0xFF);
+    CHECK_EQ(d[6], 0x5D);
+    CHECK_EQ(d[7], 0x01);
+}
+
+
+static void test_class_descriptor(void)
+{
+    static const uint8_t expected[17] = {
+        17, 0x21, 0x00, 0x01, 0x01, 0x25,
+        0x81, 20, 0x00, 0x00, 0x00, 0x00, 0x13,
+        0x05, 0x08, 0x00, 0x00
+    };
+    const uint8_t *d = xinput_config1_descriptor + CLASS_DESC_OFFSET;
+    unsigned i;
+
+    for (i = 0; i < sizeof(expected); i++)
+        CHECK_EQ(d[i], expected[i]);
+}
+
+
+static void test_endpoints(void)
+{
+    static const uint8_t in[7] = { 7, 5, 0x81, 0x03, 32, 0, 1 };
+    static const uint8_t out[7] = { 7, 5, 0x05, 0x03, 32, 0, 8 };
+    const uint8_t *d = xinput_config1_descriptor;
+    unsigned i;
+
+    for (i = 0; i < sizeof(in); i++)
+    {
+        CHECK_EQ(d[IN_EP_OFFSET + i], in[i]);
+        CHECK_EQ(d[OUT_EP_OFFSET + i], out[i]);
+    }
+}
+
+
+static void test_compat_id(void)
+{
+    const uint8_t *d = xinput_compat_id;
+
+    CHECK_EQ(sizeof(xinput_compat_id), 40);
+    CHECK_EQ(d[0], 40);
+    CHECK_EQ(d[6], 0x04);
+    CHECK_EQ(d[8], 1);
+    CHECK_EQ(d[16], GAMEPAD_INTERFACE);
+    CHECK(memcmp(d + 18, "XUSB10\0\0", 8) == 0);
+    CHECK_EQ(string_ms_os.wString[7], MS_OS_VENDOR_CODE);
+}
+
+
+static void test_report_neutral(void)
+{
+    static const uint8_t expected[XINPUT_REPORT_SIZE] = { 0x00, 20 };
+    unsigned i;
+
+    write_report(0, 128, 128);
+    CHECK_EQ(host_usb_fifo_pos, XINPUT_REPORT_SIZE);
+    for (i = 0; i < XINPUT_REPORT_SIZE; i++)
+        CHECK_EQ(host_usb_fifo[i], expected[i]);
+}
+
+
+static void test_report_buttons(void)
+{
+    unsigned i;
+
+    /* Genesis B is Xbox A, and the dpad comes from the axes */
+    write_report(GAMEPAD_BUTTON(2) | GAMEPAD_BUTTON_START
+        | XINPUT_LEFT_TRIGGER, 255, 0);
+    CHECK_EQ(host_usb_fifo_pos, XINPUT_REPORT_SIZE);
+    CHECK_EQ(host_usb_fifo[2], LSB((XINPUT_START | XINPUT_DPAD_RIGHT
+        | XINPUT_DPAD_UP)));
+    CHECK_EQ(host_usb_fifo[3], MSB(XINPUT_A));
+    CHECK_EQ(host_usb_fifo[4], 255);
+    CHECK_EQ(host_usb_fifo[5], 0);
+    /* Sticks stay centred, at zero, and the padding is zero too */
+    for (i = 6; i < XINPUT_REPORT_SIZE; i++)
+        CHECK_EQ(host_usb_fifo[i], 0);
+
+    write_report(GAMEPAD_BUTTON(1) | GAMEPAD_BUTTON(4) | GAMEPAD_BUTTON(6)
+        | GAMEPAD_BUTTON_SELECT | XINPUT_RIGHT_TRIGGER, 0, 255);
+    CHECK_EQ(host_usb_fifo[2], LSB((XINPUT_BACK | XINPUT_DPAD_LEFT
+        | XINPUT_DPAD_DOWN)));
+    CHECK_EQ(host_usb_fifo[3], MSB((XINPUT_X | XINPUT_LB | XINPUT_RB)));
+    CHECK_EQ(host_usb_fifo[4], 0);
+    CHECK_EQ(host_usb_fifo[5], 255);
+}
+
+
+/** Hand usb_com_handler() a SETUP packet on endpoint 0 */
+static void setup_request(uint8_t bmRequestType, uint8_t bRequest,
+    uint16_t wValue, uint16_t wIndex)
+{
+    host_usb_fifo[0] = bmRequestType;
+    host_usb_fifo[1] = bRequest;
+    host_usb_fifo[2] = LSB(wValue);
+    host_usb_fifo[3] = MSB(wValue);
+    host_usb_fifo[4] = LSB(wIndex);
+    host_usb_fifo[5] = MSB(wIndex);
+    host_usb_fifo[6] = 0;
+    host_usb_fifo[7] = 0;
+    host_usb_fifo_pos = 0;
+    UEINT = 1;
+    UEINTX = 1 << RXSTPI;
+    UECONX = 0;
+    usb_com_handler();
+    /* Nothing but the 8-byte request itself is read or written */
+    CHECK_EQ(host_usb_fifo_pos, 8);
+    UEINT = 0;
+}
+
+
+static void test_out_endpoint_halt(void)
+{
+    /* Clearing the halt on endpoint 5 resets it, and the status stage
+     * is a zero-length IN packet rather than a stall */
+    usb_personality = USB_PERSONALITY_XINPUT;
+    setup_request(0x02, CLEAR_FEATURE, 0, XINPUT_OUT_ENDPOINT);
+    CHECK_EQ(UEINTX, (uint8_t)~(1 << TXINI));
+    CHECK_EQ(UENUM, XINPUT_OUT_ENDPOINT);
+    CHECK_EQ(UECONX, (1 << STALLRQC) | (1 << RSTDT) | (1 << EPEN));
+
+    setup_request(0x02, SET_FEATURE, 0, XINPUT_OUT_ENDPOINT);
+    CHECK_EQ(UEINTX, (uint8_t)~(1 << TXINI));
+    CHECK_EQ(UECONX, (1 << STALLRQ) | (1 << EPEN));
+
+    /* Other personalities have no endpoint 5, so the request stalls */
+    usb_personality = USB_PERSONALITY_GAMEPAD;
+    setup_request(0x02, CLEAR_FEATURE, 0, XINPUT_OUT_ENDPOINT);
+    CHECK(UEINTX != (uint8_t)~(1 << TXINI));
+    CHECK_EQ(UENUM, 0);
+    CHECK_EQ(UECONX, (1 << STALLRQ) | (1 << EPEN));
+}
+
+
+static void test_out_endpoint(void)
+{
+    /* Endpoint 5 is only looked at for XInput */
+    usb_personality = USB_PERSONALITY_GAMEPAD;
+    UEINT = 1 << XINPUT_OUT_ENDPOINT;
+    UENUM = 0;
+    UEINTX = 0;
+    usb_com_handler();
+    CHECK_EQ(UENUM, 0);
+    CHECK_EQ(UEINTX, 0);
+
+    usb_personality = USB_PERSONALITY_XINPUT;
+    usb_com_handler();
+    CHECK_EQ(UENUM, XINPUT_OUT_ENDPOINT);
+    CHECK_EQ(UEINTX, 0x6B);
+    UEINT = 0;
+}
+
+
+int main(void)
+{
+    printf("xinput\n");
+    RUN(test_device);
+    RUN(test_config);
+    RUN(test_interface);
+    RUN(test_class_descriptor);
+    RUN(test_endpoints);
+    RUN(test_compat_id);
+    RUN(test_report_neutral);
+    RUN(test_report_buttons);
+    RUN(test_out_endpoint);
+    RUN(test_out_endpoint_halt);
+    return TEST_SUMMARY();
+}
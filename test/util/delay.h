@@ -0,0 +1,31 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef util_delay_h__
+#define util_delay_h__
+
+/* Host stand-in for <util/delay.h> (and <util/delay_basic.h>). The
+ * delays advance the virtual clock (see host.h) instead of spinning. */
+
+#include <stdint.h>
+
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+/** Four cycles per iteration, as on the AVR */
+void _delay_loop_2(uint16_t count);
+
+#endif
@@ -0,0 +1,239 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Creates a virtual converter through Linux uhid, sending a synthetic
+ * stream of generic gamepad reports, so tools/polljitter.c can be
+ * tried out without a Teensy. This runs on the host; build it with:
+ * 
+ *     $ cc -o fakepad tools/fakepad.c
+ * 
+ * and run it as root (for /dev/uhid). It prints the hidraw node it
+ * creates, and starts sending once that is opened.
+ * 
+ * Usage: fakepad [-i interval_us] [-j jitter_us] [-c count] [-s N]
+ *                [-l N] [-m N] [-u N]
+ * 
+ *  -i  report interval in microseconds (default 1000)
+ *  -j  delay each report by a random amount up to this (default 0)
+ *  -c  number of reports to send, 0 for no limit (default 0)
+ *  -s  change the buttons every N reports (default 50)
+ *  -l  lose every Nth report on the way (its sequence number is skipped)
+ *  -m  miss every Nth poll (nothing is sent for that interval)
+ *  -u  send every Nth report twice
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/uhid.h>
+
+#define DEVICE_NAME "Genesis to USB Converter (virtual)"
+
+/** Generic gamepad report descriptor for one player, as built by
+ * usb_gamepad.c */
+static const uint8_t report_desc[] = {
+    0x05, 0x01, 0x15, 0x00, 0x09, 0x04, 0xa1, 0x01, 0x05, 0x01, 0x75, 0x08,
+    0x26, 0xff, 0x00, 0x15, 0x00, 0x09, 0x01, 0xa1, 0x00, 0x09, 0x30, 0x09,
+    0x31, 0x95, 0x02, 0x81, 0x02, 0xc0, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0a,
+    0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0a, 0x55, 0x00, 0x65, 0x00,
+    0x81, 0x02, 0x95, 0x01, 0x75, 0x06, 0x81, 0x03, 0x06, 0x00, 0xff, 0x09,
+    0x03, 0x09, 0x04, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0xc0, 0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01, 0x15, 0x00, 0x26, 0xff,
+    0x00, 0x75, 0x08, 0x95, 0x28, 0x09, 0x02, 0xb1, 0x02, 0xc0
+};
+
+/** Generic gamepad report: X, Y, buttons (2), sequence, age */
+#define REPORT_SIZE 6
+#define AGE_UNIT_US 64
+
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+    if (write(fd, ev, sizeof(*ev)) != sizeof(*ev))
+    {
+        perror("uhid write");
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Wait for an event of the given type from uhid */
+static int uhid_wait(int fd, uint32_t type)
+{
+    struct uhid_event ev;
+    
+    do
+    {
+        if (read(fd, &ev, sizeof(ev)) < 0)
+        {
+            perror("uhid read");
+            return -1;
+        }
+    } while (ev.type != type);
+    return 0;
+}
+
+
+/** Print the hidraw node of the virtual converter, if it can be found */
+static void print_hidraw_node(void)
+{
+    char path[300], line[256];
+    struct dirent *entry;
+    DIR *dir;
+    FILE *f;
+    
+    dir = opendir("/sys/class/hidraw");
+    if (!dir)
+        return;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent",
+            entry->d_name);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        while (fgets(line, sizeof(line), f))
+        {
+            if (strcmp(line, "HID_NAME=" DEVICE_NAME "\n") == 0)
+                printf("Virtual converter on /dev/%s\n", entry->d_name);
+        }
+        fclose(f);
+    }
+    closedir(dir);
+}
+
+
+/** Advance a time by some microseconds */
+static void add_us(struct timespec *ts, long us)
+{
+    ts->tv_nsec += us * 1000;
+    while (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: fakepad [-i interval_us] [-j jitter_us] "
+        "[-c count] [-s N] [-l N] [-m N] [-u N]\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    long interval = 1000, jitter = 0, count = 0, change = 50;
+    long lose = 0, miss = 0, duplicate = 0, n, max_age;
+    uint8_t report[REPORT_SIZE] = { 127, 127, 0, 0, 0, 0 };
+    struct uhid_event ev;
+    struct timespec next, at;
+    int fd, opt;
+    
+    while ((opt = getopt(argc, argv, "i:j:c:s:l:m:u:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': interval = atol(optarg); break;
+        case 'j': jitter = atol(optarg); break;
+        case 'c': count = atol(optarg); break;
+        case 's': change = atol(optarg); break;
+        case 'l': lose = atol(optarg); break;
+        case 'm': miss = atol(optarg); break;
+        case 'u': duplicate = atol(optarg); break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind != argc || interval <= 0 || jitter < 0 || change <= 0)
+    {
+        usage();
+        return 2;
+    }
+    
+    fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("/dev/uhid");
+        return 1;
+    }
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    strcpy((char *)ev.u.create2.name, DEVICE_NAME);
+    ev.u.create2.rd_size = sizeof(report_desc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x16c0;
+    ev.u.create2.product = 0x27dc;
+    ev.u.create2.version = 0x0100;
+    memcpy(ev.u.create2.rd_data, report_desc, sizeof(report_desc));
+    if (uhid_write(fd, &ev) < 0 || uhid_wait(fd, UHID_START) < 0)
+        return 1;
+    print_hidraw_node();
+    
+    printf("Waiting for the node to be opened...\n");
+    fflush(stdout);
+    if (uhid_wait(fd, UHID_OPEN) < 0)
+        return 1;
+    
+    /* The sample age is random, up to one interval */
+    max_age = interval / AGE_UNIT_US;
+    if (max_age > 255)
+        max_age = 255;
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 1; count == 0 || n <= count; n++)
+    {
+        add_us(&next, interval);
+        at = next;
+        if (jitter)
+            add_us(&at, random() % (jitter + 1));
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL);
+        
+        if (miss && n % miss == 0)
+            continue;
+        if (n % change == 0)
+            report[2] = (report[2] + 1) & 0x0F;
+        report[4]++;
+        if (lose && n % lose == 0)
+            continue;
+        report[5] = random() % (max_age + 1);
+        
+        memset(&ev, 0, sizeof(ev));
+        ev.type = UHID_INPUT2;
+        ev.u.input2.size = sizeof(report);
+        memcpy(ev.u.input2.data, report, sizeof(report));
+        if (uhid_write(fd, &ev) < 0)
+            return 1;
+        if (duplicate && n % duplicate == 0 && uhid_write(fd, &ev) < 0)
+            return 1;
+    }
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    uhid_write(fd, &ev);
+    close(fd);
+    return 0;
+}
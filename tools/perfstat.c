@@ -0,0 +1,206 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Reads the converter's performance counters, and each pad's debounce
+ * chatter counts, through Linux hidraw.
+ * This runs on the host, not the Teensy; build it with:
+ * 
+ *     $ cc -o perfstat tools/perfstat.c
+ * 
+ * Usage: perfstat [-m] [-r] /dev/hidrawN
+ * 
+ *  -m  the firmware was built with MULTI_REPORT=1
+ *  -r  reset the counters (and chatter counts) after reading them
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+/** Feature report layout; see usb_gamepad.c */
+#define FEATURE_REPORT_SIZE 40
+#define FEATURE_REPORT_ID   0x10
+#define FEATURE_PAGE_PERF   1
+#define FEATURE_PAGE_CHATTER    2
+
+/** Buttons on a chatter page, in order */
+static const char *const chatter_buttons[] = {
+    "Right", "Left", "Up", "Down", "A", "B", "C", "Start",
+    "X", "Y", "Z", "Mode" };
+#define CHATTER_BUTTONS \
+    (sizeof(chatter_buttons) / sizeof(chatter_buttons[0]))
+
+/** Scheduler timer ticks per microsecond */
+#define TICKS_PER_US 2.0
+
+
+/** Little-endian fields of perf_counters_t (see perf.h) */
+static uint32_t field(const uint8_t *data, int offset, int size)
+{
+    uint32_t value = 0;
+    
+    while (size--)
+        value = (value << 8) | data[offset + size];
+    return value;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: perfstat [-m] [-r] /dev/hidrawN\n");
+}
+
+
+/** Picks a feature report page, then reads it. The first byte is the
+ * report ID either way; hidraw drops it when IDs aren't used.
+ * 
+ * \return 0 on success, or -1 with errno set if the converter
+ *         refused the page
+ */
+static int read_page(int fd, uint8_t id, uint8_t page, uint8_t *report)
+{
+    report[0] = id;
+    report[1] = page;
+    if (ioctl(fd, HIDIOCSFEATURE(2), report) < 0)
+        return -1;
+    
+    memset(report, 0, 1 + FEATURE_REPORT_SIZE);
+    report[0] = id;
+    if (ioctl(fd, HIDIOCGFEATURE(1 + FEATURE_REPORT_SIZE), report) < 0)
+        return -1;
+    if (report[1] != page)
+    {
+        fprintf(stderr, "Unexpected feature page %u\n", report[1]);
+        return -2;
+    }
+    return 0;
+}
+
+
+/** Writes a whole, zeroed feature report page, which resets it */
+static int reset_page(int fd, uint8_t id, uint8_t page)
+{
+    uint8_t report[1 + FEATURE_REPORT_SIZE];
+    
+    memset(report, 0, sizeof(report));
+    report[0] = id;
+    report[1] = page;
+    return ioctl(fd, HIDIOCSFEATURE(sizeof(report)), report) < 0 ? -1 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint8_t report[1 + FEATURE_REPORT_SIZE];
+    const uint8_t *data = report + 2;
+    uint8_t id = 0, pad;
+    unsigned i;
+    int reset = 0, fd, opt, ret;
+    uint32_t scans, frames, scan_total, mailbox_wait, isr_time;
+    
+    while ((opt = getopt(argc, argv, "mr")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            id = FEATURE_REPORT_ID;
+            break;
+        case 'r':
+            reset = 1;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage();
+        return 2;
+    }
+    
+    fd = open(argv[optind], O_RDWR);
+    if (fd < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    
+    ret = read_page(fd, id, FEATURE_PAGE_PERF, report);
+    if (ret < 0)
+    {
+        if (ret == -1)
+            perror("read counters");
+        return 1;
+    }
+    
+    scan_total = field(data, 4, 4);
+    scans = field(data, 8, 4);
+    frames = field(data, 12, 4);
+    mailbox_wait = field(data, 16, 4);
+    isr_time = field(data, 24, 4);
+    
+    printf("scans:            %u\n", scans);
+    printf("USB frames:       %u\n", frames);
+    if (frames)
+        printf("scans per frame:  %.3f\n", (double)scans / frames);
+    if (scans)
+    {
+        printf("scan time (us):   min %.1f, avg %.1f, max %.1f\n",
+            field(data, 0, 2) / TICKS_PER_US,
+            scan_total / TICKS_PER_US / scans,
+            field(data, 2, 2) / TICKS_PER_US);
+    }
+    printf("bank wait (us):   %.1f\n", mailbox_wait / TICKS_PER_US);
+    printf("reports replaced: %u\n", field(data, 20, 2));
+    printf("pad type changes: %u\n", field(data, 22, 2));
+    printf("USB ISR (us):     %.1f", isr_time / TICKS_PER_US);
+    if (frames)
+        printf(" (%.2f%% of the time)", isr_time / TICKS_PER_US / frames / 10);
+    printf("\n");
+    printf("play underruns:   %u\n", field(data, 28, 2));
+    printf("settle time (us): %u\n", field(data, 30, 1));
+    
+    if (reset && reset_page(fd, id, FEATURE_PAGE_PERF) < 0)
+    {
+        perror("reset counters");
+        return 1;
+    }
+    
+    /* One chatter page per pad; the converter refuses the page after
+     * the last pad */
+    for (pad = 0; read_page(fd, id, FEATURE_PAGE_CHATTER + pad, report) == 0;
+        pad++)
+    {
+        printf("pad %u chatter:  ", pad + 1);
+        for (i = 0; i < CHATTER_BUTTONS; i++)
+            printf(" %s %u", chatter_buttons[i], data[i]);
+        printf("\n");
+        
+        if (reset && reset_page(fd, id, FEATURE_PAGE_CHATTER + pad) < 0)
+        {
+            perror("reset chatter counts");
+            return 1;
+        }
+    }
+    
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,285 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures the rate and jitter of the converter's gamepad reports
+ * through Linux hidraw. This runs on the host, not the Teensy; build
+ * it with:
+ * 
+ *     $ cc -o polljitter tools/polljitter.c -lm
+ * 
+ * Usage: polljitter [-m] [-n reports] [-i interval_ms] /dev/hidrawN
+ * 
+ *  -m  the firmware was built with MULTI_REPORT=1 (player 1 is measured)
+ *  -n  number of reports to take (default 5000); Ctrl-C stops early
+ *  -i  nominal poll interval in ms, instead of the median measured
+ * 
+ * Only the generic gamepad personality carries the sequence number and
+ * sample age this needs. tools/fakepad.c creates a virtual converter
+ * to try it out without one.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Generic gamepad report layout; see usb_gamepad.c. The pad state
+ * comes first (X, Y and buttons, plus a throttle with XE1AP=1), and
+ * the report always ends with the sequence number and sample age. */
+#define REPORT_MIN_SIZE 6
+#define TRAILER_SIZE    2
+#define AGE_UNIT_US     64.0
+
+/** Histogram bins per nominal interval, and bins shown */
+#define BINS_PER_INTERVAL 8
+#define BINS 24
+
+/** An interval this many times the nominal one counts as missed polls */
+#define MISSED_THRESHOLD 1.5
+
+
+/** Cleared by Ctrl-C to stop taking reports */
+static volatile sig_atomic_t running = 1;
+
+
+static void stop(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+
+static double now_us(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    
+    return (x > y) - (x < y);
+}
+
+
+/** Print min, median, mean, max and standard deviation of values
+ * given in microseconds, in ms. Sorts the values. */
+static void print_spread(const char *label, double *values, int count)
+{
+    double sum = 0, squares = 0, mean;
+    int i;
+    
+    qsort(values, count, sizeof(double), compare_doubles);
+    for (i = 0; i < count; i++)
+    {
+        sum += values[i];
+        squares += values[i] * values[i];
+    }
+    mean = sum / count;
+    printf("%-18smin %.3f, median %.3f, mean %.3f, max %.3f, "
+        "std dev %.3f\n", label, values[0] / 1e3,
+        values[count / 2] / 1e3, mean / 1e3, values[count - 1] / 1e3,
+        sqrt(fabs(squares / count - mean * mean)) / 1e3);
+}
+
+
+/** Print a histogram of values in microseconds */
+static void print_histogram(const double *values, int count, double bin_us)
+{
+    int bins[BINS + 1] = { 0 };
+    int i, b, most = 1;
+    
+    for (i = 0; i < count; i++)
+    {
+        b = values[i] / bin_us;
+        bins[b < BINS ? b : BINS]++;
+    }
+    for (b = 0; b <= BINS; b++)
+    {
+        if (bins[b] > most)
+            most = bins[b];
+    }
+    for (b = 0; b <= BINS; b++)
+    {
+        if (b < BINS)
+            printf("  %7.3f-%7.3f ms ", b * bin_us / 1e3, (b + 1) * bin_us / 1e3);
+        else
+            printf("  %7.3f ms and up ", b * bin_us / 1e3);
+        printf("%7d %.*s\n", bins[b], bins[b] * 50 / most,
+            "##################################################");
+    }
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: polljitter [-m] [-n reports] [-i interval_ms] "
+        "/dev/hidrawN\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint8_t report[64], last_state[64];
+    const uint8_t *data;
+    int state_size;
+    double *intervals, *ages, nominal = 0, time, last_time = 0, first_time = 0;
+    int id = 0, wanted = 5000, count = 0, changes = 0, fd, opt, n, k;
+    int missed = 0, lost = 0, duplicates = 0;
+    uint8_t last_sequence = 0, gap;
+    struct sigaction action;
+    
+    while ((opt = getopt(argc, argv, "mn:i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            id = 1;
+            break;
+        case 'n':
+            wanted = atoi(optarg);
+            break;
+        case 'i':
+            nominal = atof(optarg) * 1e3;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || wanted < 2)
+    {
+        usage();
+        return 2;
+    }
+    
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    
+    intervals = calloc(wanted, sizeof(double));
+    ages = calloc(wanted, sizeof(double));
+    if (!intervals || !ages)
+    {
+        perror("calloc");
+        return 1;
+    }
+    
+    /* No SA_RESTART, so Ctrl-C interrupts the read */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    
+    fprintf(stderr, "Taking %d reports...\n", wanted);
+    while (running && count < wanted)
+    {
+        n = read(fd, report, sizeof(report));
+        time = now_us();
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                break;
+            perror("read");
+            return 1;
+        }
+        if (id && report[0] != id)
+            continue;
+        data = report + (id ? 1 : 0);
+        state_size = n - (id ? 1 : 0) - TRAILER_SIZE;
+        if (state_size + TRAILER_SIZE < REPORT_MIN_SIZE)
+        {
+            fprintf(stderr, "Report too short; is the converter in the "
+                "generic gamepad personality?\n");
+            return 1;
+        }
+        
+        if (count == 0)
+        {
+            first_time = time;
+        }
+        else
+        {
+            intervals[count - 1] = time - last_time;
+            gap = data[state_size] - last_sequence;
+            if (gap == 0)
+                duplicates++;
+            else
+                lost += gap - 1;
+            if (memcmp(data, last_state, state_size) != 0)
+                ages[changes++] = data[state_size + 1] * AGE_UNIT_US;
+        }
+        memcpy(last_state, data, state_size);
+        last_sequence = data[state_size];
+        last_time = time;
+        count++;
+    }
+    close(fd);
+    
+    if (count < 2)
+    {
+        fprintf(stderr, "Not enough reports\n");
+        return 1;
+    }
+    
+    printf("reports:          %d in %.3f s (%.1f Hz)\n", count,
+        (last_time - first_time) / 1e6,
+        (count - 1) / ((last_time - first_time) / 1e6));
+    print_spread("interval (ms):", intervals, count - 1);
+    if (nominal <= 0)
+        nominal = intervals[(count - 1) / 2];
+    
+    /* Gaps spanning several nominal intervals, where the sequence
+     * number didn't skip, are polls the converter had nothing new
+     * for; skipped sequence numbers are reports lost on the way */
+    for (n = 0; n < count - 1; n++)
+    {
+        if (intervals[n] >= nominal * MISSED_THRESHOLD)
+        {
+            k = intervals[n] / nominal + 0.5;
+            missed += k - 1;
+        }
+    }
+    printf("nominal interval: %.3f ms\n", nominal / 1e3);
+    print_histogram(intervals, count - 1, nominal / BINS_PER_INTERVAL);
+    printf("missed polls:     %d\n", missed - lost > 0 ? missed - lost : 0);
+    printf("lost reports:     %d\n", lost);
+    printf("duplicates:       %d\n", duplicates);
+    
+    if (changes)
+    {
+        printf("state changes:    %d\n", changes);
+        print_spread("sample age (ms):", ages, changes);
+        print_histogram(ages, changes, nominal / BINS_PER_INTERVAL);
+    }
+    
+    free(intervals);
+    free(ages);
+    return 0;
+}
@@ -0,0 +1,454 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the converter's XInput personality against what the Linux
+ * xpad driver and Windows' Xbox 360 pad driver expect, through Linux
+ * usbfs, so no Windows machine is needed. This runs on the host, not
+ * the Teensy; build it with:
+ *
+ *     $ cc -o xinputcheck tools/xinputcheck.c
+ *
+ * Usage: xinputcheck [-n reports] /dev/bus/usb/BBB/DDD
+ *
+ *  -n  number of reports to check (default 1000); 0 checks only the
+ *      descriptors. Ctrl-C stops early.
+ *
+ * Find the bus and device numbers with lsusb. It needs write access
+ * to the device node (usually root). While it reads reports, the
+ * XInput interface is taken from whichever driver had it, and given
+ * back afterwards. Button changes are shown as xpad would report them.
+ *
+ * xpad doesn't know the converter's IDs, but takes it as an Xbox 360
+ * pad once told about it:
+ *
+ *     # echo 16c0 05dc ff > /sys/bus/usb/drivers/xpad/new_id
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+/** XInput interface, as matched by xpad and Windows; see
+ * usb_gamepad.c */
+#define XINPUT_CLASS        0xFF
+#define XINPUT_SUBCLASS     0x5D
+#define XINPUT_PROTOCOL     0x01
+#define XINPUT_CLASS_DESC   0x21
+#define XINPUT_CLASS_DESC_SIZE 17
+
+/** Input report: message type 0, its size, 16 bits of buttons, two
+ * triggers, four 16-bit stick axes, then padding */
+#define REPORT_SIZE         20
+#define REPORT_PADDING      14
+
+/** Button bit xpad leaves unused */
+#define UNUSED_BUTTON       0x0800
+
+/** Microsoft OS descriptors, which Windows uses to pick its driver */
+#define MS_OS_STRING_INDEX  0xEE
+#define MS_OS_STRING_SIZE   18
+#define MS_OS_COMPAT_INDEX  0x0004
+#define MS_OS_COMPAT_SIZE   40
+
+#define USB_TIMEOUT_MS      1000
+
+
+/** The XInput interface found in the configuration descriptor */
+struct xinput_interface {
+    int found;
+    int number;
+    int endpoints;          /**< bNumEndpoints */
+    int class_desc;         /**< Size of its class descriptor, 0 if none */
+    uint8_t ep[2];          /**< First two endpoint addresses */
+    uint8_t ep_type[2];     /**< and their bmAttributes */
+    uint16_t ep_size[2];
+    uint8_t ep_interval[2];
+    int seen;               /**< Endpoints seen so far */
+};
+
+/** Buttons in xpad's Xbox 360 report decoding, by evdev name */
+static const struct {
+    uint16_t bit;
+    const char *name;
+} buttons[] = {
+    { 0x0010, "BTN_START" },
+    { 0x0020, "BTN_SELECT" },
+    { 0x0040, "BTN_THUMBL" },
+    { 0x0080, "BTN_THUMBR" },
+    { 0x0100, "BTN_TL" },
+    { 0x0200, "BTN_TR" },
+    { 0x0400, "BTN_MODE" },
+    { 0x1000, "BTN_A" },
+    { 0x2000, "BTN_B" },
+    { 0x4000, "BTN_X" },
+    { 0x8000, "BTN_Y" },
+};
+
+/** Dpad bits, which xpad reports as ABS_HAT0X and ABS_HAT0Y */
+#define DPAD_UP     0x0001
+#define DPAD_DOWN   0x0002
+#define DPAD_LEFT   0x0004
+#define DPAD_RIGHT  0x0008
+
+
+/** Cleared by Ctrl-C to stop taking reports */
+static volatile sig_atomic_t running = 1;
+
+static int failures = 0;
+
+
+static void stop(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/** Print the outcome of one check, counting failures */
+static void check(int ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+
+static int control(int fd, uint8_t type, uint8_t request, uint16_t value,
+    uint16_t index, uint8_t *data, uint16_t length)
+{
+    struct usbdevfs_ctrltransfer ctrl = {
+        .bRequestType = type,
+        .bRequest = request,
+        .wValue = value,
+        .wIndex = index,
+        .wLength = length,
+        .timeout = USB_TIMEOUT_MS,
+        .data = data
+    };
+
+    return ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+}
+
+
+/** Find the XInput interface among the descriptors usbfs returns: the
+ * device descriptor, then the configuration descriptors */
+static void find_interface(const uint8_t *desc, int len,
+    struct xinput_interface *xi)
+{
+    int i, in_xinput = 0;
+
+    memset(xi, 0, sizeof(*xi));
+    for (i = 0; i + 2 <= len && desc[i] >= 2; i += desc[i])
+    {
+        if (i + desc[i] > len)
+            break;
+        switch (desc[i + 1])
+        {
+        case 4:
+            in_xinput = !xi->found && desc[i + 3] == 0
+                && desc[i + 5] == XINPUT_CLASS
+                && desc[i + 6] == XINPUT_SUBCLASS
+                && desc[i + 7] == XINPUT_PROTOCOL;
+            if (in_xinput)
+            {
+                xi->found = 1;
+                xi->number = desc[i + 2];
+                xi->endpoints = desc[i + 4];
+            }
+            break;
+        case XINPUT_CLASS_DESC:
+            if (in_xinput && !xi->seen)
+                xi->class_desc = desc[i];
+            break;
+        case 5:
+            if (in_xinput && xi->seen < 2)
+            {
+                xi->ep[xi->seen] = desc[i + 2];
+                xi->ep_type[xi->seen] = desc[i + 3];
+                xi->ep_size[xi->seen] = desc[i + 4] | (desc[i + 5] << 8);
+                xi->ep_interval[xi->seen] = desc[i + 6];
+                xi->seen++;
+            }
+            break;
+        }
+    }
+}
+
+
+/** Check the descriptors xpad probes the interface with. Returns the
+ * IN endpoint's index in xi->ep, or -1 if there isn't a usable one. */
+static int check_interface(const struct xinput_interface *xi)
+{
+    int in = -1, out = -1, k;
+    char line[80];
+
+    check(xi->found, "vendor class interface, subclass 0x5D, protocol 0x01");
+    if (!xi->found)
+        return -1;
+    printf("     interface %d\n", xi->number);
+    check(xi->endpoints == 2 && xi->seen == 2, "exactly two endpoints");
+    for (k = 0; k < xi->seen; k++)
+    {
+        if ((xi->ep_type[k] & 0x03) != 0x03)
+            continue;
+        if (xi->ep[k] & 0x80)
+            in = k;
+        else
+            out = k;
+    }
+    check(in >= 0, "interrupt IN endpoint");
+    check(out >= 0, "interrupt OUT endpoint");
+    check(xi->class_desc == XINPUT_CLASS_DESC_SIZE,
+        "Xbox 360 class descriptor before the endpoints");
+    if (in < 0)
+        return -1;
+
+    snprintf(line, sizeof(line), "IN endpoint 0x%02x polled every 1ms "
+        "(bInterval %d)", xi->ep[in], xi->ep_interval[in]);
+    check(xi->ep_interval[in] == 1, line);
+    snprintf(line, sizeof(line), "IN endpoint holds a whole report "
+        "(wMaxPacketSize %d)", xi->ep_size[in]);
+    check(xi->ep_size[in] >= REPORT_SIZE, line);
+    return in;
+}
+
+
+/** Check the Microsoft OS descriptors that get Windows to load its
+ * Xbox 360 pad driver for the interface */
+static void check_ms_os(int fd, int number)
+{
+    uint8_t data[64];
+    int n;
+
+    n = control(fd, 0x80, 6, 0x0300 | MS_OS_STRING_INDEX, 0, data,
+        MS_OS_STRING_SIZE);
+    check(n == MS_OS_STRING_SIZE && data[1] == 3
+        && memcmp(data + 2, "M\0S\0F\0T\0" "1\0" "0\0" "0\0", 14) == 0,
+        "Microsoft OS string descriptor");
+    if (n != MS_OS_STRING_SIZE)
+        return;
+
+    n = control(fd, 0xC0, data[16], 0, MS_OS_COMPAT_INDEX, data,
+        MS_OS_COMPAT_SIZE);
+    check(n == MS_OS_COMPAT_SIZE && data[4] == 0x00 && data[5] == 0x01
+        && data[6] == 0x04 && data[8] >= 1,
+        "Microsoft extended compat ID descriptor");
+    if (n != MS_OS_COMPAT_SIZE)
+        return;
+    check(data[16] == number && memcmp(data + 18, "XUSB10\0\0", 8) == 0,
+        "compatible ID XUSB10 for the XInput interface");
+}
+
+
+/** Print the buttons in a report as xpad reports them */
+static void print_report(double time, const uint8_t *data)
+{
+    uint16_t bits = data[2] | (data[3] << 8);
+    unsigned i;
+
+    printf("%9.3f s ", time / 1e6);
+    for (i = 0; i < sizeof(buttons) / sizeof(buttons[0]); i++)
+    {
+        if (bits & buttons[i].bit)
+            printf(" %s", buttons[i].name);
+    }
+    printf("  ABS_HAT0X %d ABS_HAT0Y %d ABS_Z %d ABS_RZ %d\n",
+        !!(bits & DPAD_RIGHT) - !!(bits & DPAD_LEFT),
+        !!(bits & DPAD_DOWN) - !!(bits & DPAD_UP), data[4], data[5]);
+}
+
+
+/** Take reports from the IN endpoint and check their format. Returns
+ * the number of reports taken. */
+static int check_reports(int fd, int number, uint8_t ep, int wanted)
+{
+    struct usbdevfs_ioctl detach = {
+        .ifno = number,
+        .ioctl_code = USBDEVFS_DISCONNECT,
+        .data = NULL
+    };
+    struct usbdevfs_bulktransfer transfer;
+    uint8_t data[64], last[REPORT_SIZE];
+    double time, first_time = 0, last_time = 0;
+    int count = 0, bad = 0, n, i;
+    unsigned int ifno = number;
+    char line[80];
+
+    /* Not bound to any driver is fine */
+    if (ioctl(fd, USBDEVFS_IOCTL, &detach) < 0 && errno != ENODATA)
+        perror("detaching the driver");
+    if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &ifno) < 0)
+    {
+        perror("claiming the interface");
+        failures++;
+        return 0;
+    }
+
+    fprintf(stderr, "Taking %d reports; press some buttons...\n", wanted);
+    memset(last, 0, sizeof(last));
+    while (running && count < wanted)
+    {
+        transfer.ep = ep;
+        transfer.len = sizeof(data);
+        transfer.timeout = USB_TIMEOUT_MS;
+        transfer.data = data;
+        n = ioctl(fd, USBDEVFS_BULK, &transfer);
+        time = now_us();
+        if (n < 0)
+        {
+            if (errno != EINTR)
+            {
+                perror("reading a report");
+                failures++;
+            }
+            break;
+        }
+
+        if (n != REPORT_SIZE || data[0] != 0x00 || data[1] != REPORT_SIZE
+            || (data[3] << 8 & UNUSED_BUTTON))
+        {
+            if (bad++ == 0)
+            {
+                printf("     bad report (%d bytes):", n);
+                for (i = 0; i < n; i++)
+                    printf(" %02x", data[i]);
+                printf("\n");
+            }
+            continue;
+        }
+        for (i = REPORT_PADDING; i < REPORT_SIZE; i++)
+        {
+            if (data[i])
+                break;
+        }
+        if (i < REPORT_SIZE)
+        {
+            bad++;
+            continue;
+        }
+
+        if (count == 0)
+            first_time = time;
+        if (count == 0 || memcmp(data, last, REPORT_SIZE) != 0)
+            print_report(time - first_time, data);
+        memcpy(last, data, REPORT_SIZE);
+        last_time = time;
+        count++;
+    }
+
+    ioctl(fd, USBDEVFS_RELEASEINTERFACE, &ifno);
+    detach.ioctl_code = USBDEVFS_CONNECT;
+    ioctl(fd, USBDEVFS_IOCTL, &detach);
+
+    snprintf(line, sizeof(line), "%d reports in xpad's Xbox 360 format, "
+        "%d not", count, bad);
+    check(count > 0 && bad == 0, line);
+    if (count > 1)
+    {
+        printf("     %.1f reports/s\n",
+            (count - 1) / ((last_time - first_time) / 1e6));
+    }
+    return count;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: xinputcheck [-n reports] /dev/bus/usb/BBB/DDD\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct xinput_interface xi;
+    struct sigaction action;
+    uint8_t desc[4096];
+    int wanted = 1000, fd, opt, len, in;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            wanted = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || wanted < 0)
+    {
+        usage();
+        return 2;
+    }
+
+    fd = open(argv[optind], O_RDWR);
+    if (fd < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    /* usbfs reads back the device descriptor, then the configurations */
+    len = read(fd, desc, sizeof(desc));
+    if (len < 18 || desc[1] != 1)
+    {
+        fprintf(stderr, "Couldn't read the descriptors\n");
+        return 1;
+    }
+    printf("     device %04x:%04x\n", desc[8] | (desc[9] << 8),
+        desc[10] | (desc[11] << 8));
+
+    find_interface(desc + 18, len - 18, &xi);
+    in = check_interface(&xi);
+    if (in < 0)
+    {
+        fprintf(stderr, "Is the converter in the XInput personality?\n");
+        return 1;
+    }
+    check_ms_os(fd, xi.number);
+
+    /* No SA_RESTART, so Ctrl-C interrupts the transfer */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+
+    if (wanted)
+        check_reports(fd, xi.number, xi.ep[in], wanted);
+    close(fd);
+
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
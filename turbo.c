@@ -0,0 +1,73 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdbool.h>
+
+#include "turbo.h"
+#include "usb_gamepad.h"
+
+
+uint16_t turbo_buttons[GENESIS_NUM_PADS];
+
+/** Button bits of each pad at the last call, to spot new presses */
+static uint16_t last_buttons[GENESIS_NUM_PADS];
+
+/** USB frame number turbo_update() last counted up to */
+static uint8_t last_frame;
+
+/** Frames into the current half cycle, plus any just counted up to.
+ * Wide enough for a whole wrap of the frame number on top of a half
+ * cycle, so a long gap between scans doesn't lose the phase. */
+static uint16_t frame_count;
+
+/** Set for the half of the cycle where turbo buttons read released */
+static bool released_half;
+
+
+void turbo_update(void)
+{
+    uint8_t frame = usb_sof_frame;
+    
+    /* Counting elapsed frames, rather than dividing the frame
+     * number, keeps the cycle even across frame number wrap-around */
+    frame_count += (uint8_t)(frame - last_frame);
+    last_frame = frame;
+    
+    while (frame_count >= TURBO_FRAMES)
+    {
+        frame_count -= TURBO_FRAMES;
+        released_half = !released_half;
+    }
+}
+
+
+uint16_t turbo_filter(uint8_t pad, uint16_t buttons)
+{
+    uint16_t pressed = buttons & ~last_buttons[pad];
+    
+    last_buttons[pad] = buttons;
+    
+    if (buttons & GEN_BIT(GEN_MODE))
+    {
+        turbo_buttons[pad] ^= pressed & TURBO_BUTTONS;
+        return buttons & ~TURBO_BUTTONS;
+    }
+    
+    if (released_half)
+        buttons &= ~turbo_buttons[pad];
+    
+    return buttons;
+}
@@ -0,0 +1,52 @@
+/* Genesis to USB Converter
+ * Copyright (C) 2018 Ryan Armstrong <git@zerker.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef turbo_h__
+#define turbo_h__
+
+#include <stdint.h>
+
+#include "genesis_pad.h"
+
+/** USB frames (ms) a turbo button spends pressed, and then released,
+ * in each cycle. 25 gives 20 presses a second. Fixed at build time. */
+#ifndef TURBO_FRAMES
+#define TURBO_FRAMES 25
+#endif
+
+/** Buttons that can be set to turbo */
+#define TURBO_BUTTONS (GEN_BIT(GEN_A) | GEN_BIT(GEN_B) | GEN_BIT(GEN_C) | \
+    GEN_BIT(GEN_X) | GEN_BIT(GEN_Y) | GEN_BIT(GEN_Z))
+
+/** Buttons set to turbo on each pad, one GEN_BIT each */
+extern uint16_t turbo_buttons[GENESIS_NUM_PADS];
+
+/** Advance the turbo cycle to the current USB frame. Call once
+ * before filtering each scan. */
+void turbo_update(void);
+
+/** Apply turbo to one pad's button bits, and handle turbo toggles:
+ * pressing a button while Mode is held sets it to turbo, or back.
+ * Buttons that can be set to turbo aren't reported while Mode is
+ * held.
+ * 
+ * \param pad Which pad the button bits came from
+ * \param buttons Button bits, after debouncing
+ * \return Button bits to report
+ */
+uint16_t turbo_filter(uint8_t pad, uint16_t buttons);
+
+#endif
@@ -43,7 +43,16 @@
 
 #define USB_GAMEPAD_PRIVATE_INCLUDE
 
+#include <stddef.h>
+#include <string.h>
 #include "usb_gamepad.h"
+#include "scan_sched.h"
+#include "settings.h"
+#include "probe.h"
+#include "perf.h"
+#include "debounce.h"
+#include "event_log.h"
+#include "playback.h"
 
 /**************************************************************************
  *
@@ -62,6 +71,54 @@
 // match the INF file.
 #define VENDOR_ID		0x16C0
 #define PRODUCT_ID		0x27dc
+#define KEYBOARD_PRODUCT_ID	0x27db
+// The XInput personality is a vendor class device, so it takes the
+// shared ID for those. Windows loads its Xbox 360 pad driver for it
+// from the Microsoft OS descriptors, and Linux needs xpad told about
+// it (see tools/xinputcheck.c).
+#define XINPUT_PRODUCT_ID	0x05dc
+
+
+// Keys sent by the keyboard personality for gamepad buttons 1 to 10
+// (Genesis A, B, C, X, Y, Z, unused, unused, Mode, Start), and for
+// the dpad. Usage IDs from the HID Usage Tables, Keyboard page.
+#define KEYBOARD_BUTTON_KEYS \
+    0x1D, 0x1B, 0x06,       /* Z, X, C */ \
+    0x04, 0x16, 0x07,       /* A, S, D */ \
+    0, 0, \
+    0x2C, 0x28              /* Space, Enter */
+#define KEY_RIGHT   0x4F
+#define KEY_LEFT    0x50
+#define KEY_DOWN    0x51
+#define KEY_UP      0x52
+
+
+// Bits of the XInput report's button field
+#define XINPUT_DPAD_UP      0x0001
+#define XINPUT_DPAD_DOWN    0x0002
+#define XINPUT_DPAD_LEFT    0x0004
+#define XINPUT_DPAD_RIGHT   0x0008
+#define XINPUT_START        0x0010
+#define XINPUT_BACK         0x0020
+#define XINPUT_LB           0x0100
+#define XINPUT_RB           0x0200
+#define XINPUT_A            0x1000
+#define XINPUT_B            0x2000
+#define XINPUT_X            0x4000
+#define XINPUT_Y            0x8000
+
+// Xbox buttons sent by the XInput personality for gamepad buttons 1
+// to 10 (Genesis A, B, C, X, Y, Z, unused, unused, Mode, Start). The
+// face buttons sit where RetroArch's Genesis cores expect them, so B
+// is the bottom one. Buttons 7 and 8 are the left and right triggers,
+// sent fully pulled.
+#define XINPUT_BUTTON_BITS \
+    XINPUT_X, XINPUT_A, XINPUT_B, \
+    XINPUT_LB, XINPUT_Y, XINPUT_RB, \
+    0, 0, \
+    XINPUT_BACK, XINPUT_START
+#define XINPUT_LEFT_TRIGGER     GAMEPAD_BUTTON(7)
+#define XINPUT_RIGHT_TRIGGER    GAMEPAD_BUTTON(8)
 
 
 // USB devices are supposed to implment a halt feature, which is
@@ -81,16 +138,197 @@
 
 #define ENDPOINT0_SIZE  64
 
+// With GAMEPAD_MULTI_REPORT, all players share one interface and
+// endpoint, with a report ID per player. Otherwise each player gets
+// their own interface, starting at GAMEPAD_INTERFACE, and endpoint,
+// starting at GAMEPAD_ENDPOINT.
+#ifdef GAMEPAD_MULTI_REPORT
+#define GAMEPAD_INTERFACES  1
+#else
+#define GAMEPAD_INTERFACES  GAMEPAD_PLAYERS
+#endif
+
+#if GAMEPAD_INTERFACES > MAX_ENDPOINT
+#error "Not enough endpoints for one interface per player; use GAMEPAD_MULTI_REPORT"
+#endif
+
+#if GAMEPAD_PLAYERS > 7
+#error "At most 7 players are supported"
+#endif
+
+// The keyboard and XInput personalities only have the first interface
+#define KEYBOARD_INTERFACES 1
+#define XINPUT_INTERFACES   1
+
+// Feature report for configuration and diagnostics: a page number,
+// then that page's data, padded to FEATURE_REPORT_SIZE. Setting just
+// the page number picks the page later Get_Reports return; setting a
+// whole page writes it. With GAMEPAD_MULTI_REPORT it has its own
+// report ID, after the players.
+#define FEATURE_REPORT_SIZE 40
+#define FEATURE_REPORT_ID   0x10
+
+// Button remapping: the active profile, then each profile's
+// settings.remap entries in turn
+#define FEATURE_PAGE_REMAP  0
+#define REMAP_PAGE_SIZE     (1 + REMAP_PROFILES * REMAP_BUTTONS)
+
+// Performance counters (perf_counters_t); writing resets them
+#define FEATURE_PAGE_PERF   1
+
+// Debounce chatter counts (debounce_chatter), one page per pad from
+// this one on: a byte per button from Right to Mode. Writing a page
+// clears that pad's counts.
+#define FEATURE_PAGE_CHATTER    2
+#define CHATTER_PAGE_SIZE       (NUM_GEN_BUTTONS - 1)
+
+// Keys covered by the keyboard's bitmap (usage IDs 0 to 0x67), and
+// the keys a boot protocol report can hold
+#define KEYBOARD_BITMAP_KEYS    0x68
+#define KEYBOARD_BOOT_KEYS      6
+
 #define GAMEPAD_INTERFACE   0
 #define GAMEPAD_ENDPOINT    1
 #define GAMEPAD_SIZE        64
-#define GAMEPAD_BUFFER  EP_DOUBLE_BUFFER
+// Single buffered so a report never queues up behind an older one,
+// and so TXINI marks the moment the host collects it.
+#define GAMEPAD_BUFFER  EP_SINGLE_BUFFER
+
+// Unit of the sample age in the generic gamepad report, in timer
+// ticks (64us)
+#define GAMEPAD_AGE_UNIT    128
+
+// Longest gap between polls, in frames, the scan scheduler will
+// try to predict.
+#define GAMEPAD_MAX_POLL_INTERVAL   32
+
+#define GAMEPAD_EP_CONFIG \
+    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(GAMEPAD_SIZE) | GAMEPAD_BUFFER
+
+// XInput personality: the input report goes out on the first gamepad
+// endpoint, polled every 1ms. Its interface also needs an interrupt
+// OUT endpoint for rumble and LED commands, which are thrown away. It
+// is numbered past every other endpoint (the ATmega32U4 has six), so
+// the rest are laid out the same for every personality.
+#define XINPUT_SIZE         32
+#define XINPUT_REPORT_SIZE  20
+#define XINPUT_OUT_ENDPOINT 5
+#define XINPUT_OUT_SIZE     32
+#if defined(USB_XINPUT) && XINPUT_OUT_ENDPOINT > HW_MAX_ENDPOINT
+#error "This chip has no endpoint left for the XInput OUT endpoint"
+#endif
+
+// Vendor request that Windows uses to fetch xinput_compat_id, as named
+// in the Microsoft OS string descriptor
+#define MS_OS_VENDOR_CODE   0x20
+
+// Mega Mouse (GENESIS_MEGA_MOUSE): a HID mouse interface after the
+// personality's own ones, with an interrupt IN endpoint after the
+// gamepad endpoints, polled every 1ms. Each report is the buttons,
+// then X and Y motion as 16-bit counts, so a fast mouse never
+// saturates a report.
+#ifdef GENESIS_MEGA_MOUSE
+#define MOUSE_INTERFACES    1
+#define MOUSE_ENDPOINT      (GAMEPAD_ENDPOINT + GAMEPAD_INTERFACES)
+#define MOUSE_SIZE          8
+#define MOUSE_INTERVAL      1
+
+#if MOUSE_ENDPOINT > MAX_ENDPOINT
+#error "Not enough endpoints for the mouse; use GAMEPAD_MULTI_REPORT"
+#endif
+
+// Single buffered, like the gamepad endpoints, so motion keeps adding
+// up until the host collects the last report
+#define MOUSE_EP_CONFIG \
+    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(MOUSE_SIZE) | EP_SINGLE_BUFFER
+#else
+#define MOUSE_INTERFACES    0
+#define MOUSE_ENDPOINT      0
+#endif
+
+// Input event log (EVENT_LOG): a vendor-specific interface after the
+// HID ones, with an interrupt IN endpoint after theirs. Each
+// packet is a header (event count, packet sequence number and
+// event_log_dropped) followed by the events.
+#ifdef EVENT_LOG
+#define EVENT_INTERFACES    1
+#define EVENT_ENDPOINT      (GAMEPAD_ENDPOINT + GAMEPAD_INTERFACES + MOUSE_INTERFACES)
+#define EVENT_SIZE          64
+#define EVENT_HEADER_SIZE   4
+#define EVENTS_PER_PACKET   ((EVENT_SIZE - EVENT_HEADER_SIZE) / sizeof(input_event_t))
+
+#if EVENT_ENDPOINT > MAX_ENDPOINT
+#error "Not enough endpoints for the event log; use GAMEPAD_MULTI_REPORT"
+#endif
+
+// Double buffered, so one batch can fill while the last one waits
+#define EVENT_EP_CONFIG \
+    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(EVENT_SIZE) | EP_DOUBLE_BUFFER
+#else
+#define EVENT_INTERFACES    0
+#define EVENT_ENDPOINT      0
+#endif
+
+// Input playback (PLAYBACK): a vendor-specific interface after the
+// event log, with an interrupt OUT endpoint. Each packet is a flags
+// byte (PLAYBACK_START, PLAYBACK_END) followed by whole frames.
+#ifdef PLAYBACK
+#define PLAYBACK_INTERFACES 1
+#define PLAYBACK_ENDPOINT   (GAMEPAD_ENDPOINT + GAMEPAD_INTERFACES + MOUSE_INTERFACES \
+    + EVENT_INTERFACES)
+#define PLAYBACK_SIZE       64
+#define FRAMES_PER_PACKET   ((PLAYBACK_SIZE - 1) / PLAYBACK_FRAME_SIZE)
+
+#if PLAYBACK_ENDPOINT > MAX_ENDPOINT
+#error "Not enough endpoints for playback; use GAMEPAD_MULTI_REPORT"
+#endif
+#if PLAYBACK_FRAMES < FRAMES_PER_PACKET
+#error "PLAYBACK_FRAMES must hold at least one packet"
+#endif
+
+// Double buffered, so the host can have the next packet waiting
+#define PLAYBACK_EP_CONFIG \
+    1, EP_TYPE_INTERRUPT_OUT, EP_SIZE(PLAYBACK_SIZE) | EP_DOUBLE_BUFFER
+#else
+#define PLAYBACK_INTERFACES 0
+#define PLAYBACK_ENDPOINT   0
+#endif
 
 static const uint8_t PROGMEM endpoint_config_table[] = {
-    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(GAMEPAD_SIZE) | GAMEPAD_BUFFER,
+    GAMEPAD_EP_CONFIG,
+#if GAMEPAD_INTERFACES > 1
+    GAMEPAD_EP_CONFIG,
+#elif MOUSE_ENDPOINT == 2
+    MOUSE_EP_CONFIG,
+#elif EVENT_ENDPOINT == 2
+    EVENT_EP_CONFIG,
+#elif PLAYBACK_ENDPOINT == 2
+    PLAYBACK_EP_CONFIG,
+#else
     0,
+#endif
+#if GAMEPAD_INTERFACES > 2
+    GAMEPAD_EP_CONFIG,
+#elif MOUSE_ENDPOINT == 3
+    MOUSE_EP_CONFIG,
+#elif EVENT_ENDPOINT == 3
+    EVENT_EP_CONFIG,
+#elif PLAYBACK_ENDPOINT == 3
+    PLAYBACK_EP_CONFIG,
+#else
     0,
+#endif
+#if GAMEPAD_INTERFACES > 3
+    GAMEPAD_EP_CONFIG
+#elif MOUSE_ENDPOINT == 4
+    MOUSE_EP_CONFIG
+#elif EVENT_ENDPOINT == 4
+    EVENT_EP_CONFIG
+#elif PLAYBACK_ENDPOINT == 4
+    PLAYBACK_EP_CONFIG
+#else
     0
+#endif
 };
 
 
@@ -107,104 +345,472 @@ static const uint8_t PROGMEM endpoint_config_table[] = {
 // spec and relevant portions of any USB class specifications!
 
 
-static const uint8_t PROGMEM device_descriptor[] = {
-    18,                 // bLength
-    1,                  // bDescriptorType
-    0x10, 0x01,             // bcdUSB
-    0,                  // bDeviceClass
-    0,                  // bDeviceSubClass
-    0,                  // bDeviceProtocol
-    ENDPOINT0_SIZE,             // bMaxPacketSize0
-    LSB(VENDOR_ID), MSB(VENDOR_ID),     // idVendor
-    LSB(PRODUCT_ID), MSB(PRODUCT_ID),   // idProduct
-    0x00, 0x01,             // bcdDevice
-    1,                  // iManufacturer
-    2,                  // iProduct
-    0,                  // iSerialNumber
-    1                   // bNumConfigurations
-};
+// Each personality gets its own product ID or release number, since
+// hosts cache descriptors by these
+#define DEVICE_DESC(pid, release) { \
+    18,                 /* bLength */ \
+    1,                  /* bDescriptorType */ \
+    0x10, 0x01,             /* bcdUSB */ \
+    0,                  /* bDeviceClass */ \
+    0,                  /* bDeviceSubClass */ \
+    0,                  /* bDeviceProtocol */ \
+    ENDPOINT0_SIZE,             /* bMaxPacketSize0 */ \
+    LSB(VENDOR_ID), MSB(VENDOR_ID),     /* idVendor */ \
+    LSB(pid), MSB(pid),         /* idProduct */ \
+    LSB(release), MSB(release),     /* bcdDevice */ \
+    1,                  /* iManufacturer */ \
+    2,                  /* iProduct */ \
+    0,                  /* iSerialNumber */ \
+    1                   /* bNumConfigurations */ \
+}
+
+static const uint8_t PROGMEM device_descriptor[] =
+    DEVICE_DESC(PRODUCT_ID, 0x0100);
+static const uint8_t PROGMEM ps3_device_descriptor[] =
+    DEVICE_DESC(PRODUCT_ID, 0x0110);
+static const uint8_t PROGMEM keyboard_device_descriptor[] =
+    DEVICE_DESC(KEYBOARD_PRODUCT_ID, 0x0100);
+#ifdef USB_XINPUT
+static const uint8_t PROGMEM xinput_device_descriptor[] =
+    DEVICE_DESC(XINPUT_PRODUCT_ID, 0x0100);
+#endif
+
+#ifdef GAMEPAD_MULTI_REPORT
+#define GAMEPAD_REPORT_ID(id) \
+    0x85, (id),                    /*   REPORT_ID (id) */
+#else
+#define GAMEPAD_REPORT_ID(id)
+#endif
+
+// One collection per player with GAMEPAD_MULTI_REPORT, or just the
+// first otherwise
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 1
+#define PLAYER_COLLECTION_2(C)  , C(2)
+#else
+#define PLAYER_COLLECTION_2(C)
+#endif
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 2
+#define PLAYER_COLLECTION_3(C)  , C(3)
+#else
+#define PLAYER_COLLECTION_3(C)
+#endif
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 3
+#define PLAYER_COLLECTION_4(C)  , C(4)
+#else
+#define PLAYER_COLLECTION_4(C)
+#endif
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 4
+#define PLAYER_COLLECTION_5(C)  , C(5)
+#else
+#define PLAYER_COLLECTION_5(C)
+#endif
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 5
+#define PLAYER_COLLECTION_6(C)  , C(6)
+#else
+#define PLAYER_COLLECTION_6(C)
+#endif
+#if defined(GAMEPAD_MULTI_REPORT) && GAMEPAD_PLAYERS > 6
+#define PLAYER_COLLECTION_7(C)  , C(7)
+#else
+#define PLAYER_COLLECTION_7(C)
+#endif
+#define PLAYER_COLLECTIONS(C) \
+    C(1) PLAYER_COLLECTION_2(C) PLAYER_COLLECTION_3(C) \
+    PLAYER_COLLECTION_4(C) PLAYER_COLLECTION_5(C) \
+    PLAYER_COLLECTION_6(C) PLAYER_COLLECTION_7(C)
+
+// Throttle axis of an analog pad, after the buttons
+#ifdef GENESIS_XE1AP
+#define GAMEPAD_ANALOG_AXES \
+    0x05, 0x01,                    /*   USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x32,                    /*   USAGE (Z) */ \
+    0x26, 0xff, 0x00,              /*   LOGICAL_MAXIMUM (255) */ \
+    0x75, 0x08,                    /*   REPORT_SIZE (8) */ \
+    0x95, 0x01,                    /*   REPORT_COUNT (1) */ \
+    0x81, 0x02,                    /*   INPUT (Data,Var,Abs) */
+#else
+#define GAMEPAD_ANALOG_AXES
+#endif
+
+// One joystick collection; repeated per player with report IDs
+#define GAMEPAD_COLLECTION(id) \
+    0x05, 0x01,                    /* USAGE_PAGE (Generic Desktop) */ \
+    0x15, 0x00,                    /* LOGICAL_MINIMUM (0) */ \
+    0x09, 0x04,                    /* USAGE (Joystick) */ \
+    0xa1, 0x01,                    /* COLLECTION (Application) */ \
+    GAMEPAD_REPORT_ID(id) \
+    0x05, 0x01,                    /*   USAGE_PAGE (Generic Desktop) */ \
+    0x75, 0x08,                    /*   REPORT_SIZE (8) */ \
+    0x26, 0xff, 0x00,              /*   LOGICAL_MAXIMUM (255) */ \
+    0x15, 0x00,                    /*   LOGICAL_MINIMUM (0) */ \
+    0x09, 0x01,                    /*   USAGE (Pointer) */ \
+    0xa1, 0x00,                    /*   COLLECTION (Physical) */ \
+    0x09, 0x30,                    /*     USAGE (X) */ \
+    0x09, 0x31,                    /*     USAGE (Y) */ \
+    0x95, 0x02,                    /*     REPORT_COUNT (2) */ \
+    0x81, 0x02,                    /*     INPUT (Data,Var,Abs) */ \
+    0xc0,                          /*   END_COLLECTION */ \
+    0x05, 0x09,                    /*   USAGE_PAGE (Button) */ \
+    0x19, 0x01,                    /*   USAGE_MINIMUM (Button 1) */ \
+    0x29, 0x0a,                    /*   USAGE_MAXIMUM (Button 10) */ \
+    0x15, 0x00,                    /*   LOGICAL_MINIMUM (0) */ \
+    0x25, 0x01,                    /*   LOGICAL_MAXIMUM (1) */ \
+    0x75, 0x01,                    /*   REPORT_SIZE (1) */ \
+    0x95, 0x0a,                    /*   REPORT_COUNT (10) */ \
+    0x55, 0x00,                    /*   UNIT_EXPONENT (0) */ \
+    0x65, 0x00,                    /*   UNIT (None) */ \
+    0x81, 0x02,                    /*   INPUT (Data,Var,Abs) */ \
+    0x95, 0x01,                    /*   REPORT_COUNT (1) */ \
+    0x75, 0x06,                    /*   REPORT_SIZE (6) */ \
+    0x81, 0x03,                    /*   INPUT (Cnst,Var,Abs) */ \
+    GAMEPAD_ANALOG_AXES \
+    0x06, 0x00, 0xff,              /*   USAGE_PAGE (Vendor Defined 0xFF00) */ \
+    0x09, 0x03,                    /*   USAGE (Vendor Usage 3) */ \
+    0x09, 0x04,                    /*   USAGE (Vendor Usage 4) */ \
+    0x26, 0xff, 0x00,              /*   LOGICAL_MAXIMUM (255) */ \
+    0x75, 0x08,                    /*   REPORT_SIZE (8) */ \
+    0x95, 0x02,                    /*   REPORT_COUNT (2) */ \
+    0x81, 0x02,                    /*   INPUT (Data,Var,Abs) */ \
+    0xc0                           /* END_COLLECTION */
+
+// Vendor collection for the feature report
+#define FEATURE_COLLECTION \
+    0x06, 0x00, 0xff,              /* USAGE_PAGE (Vendor Defined 0xFF00) */ \
+    0x09, 0x01,                    /* USAGE (Vendor Usage 1) */ \
+    0xa1, 0x01,                    /* COLLECTION (Application) */ \
+    GAMEPAD_REPORT_ID(FEATURE_REPORT_ID) \
+    0x15, 0x00,                    /*   LOGICAL_MINIMUM (0) */ \
+    0x26, 0xff, 0x00,              /*   LOGICAL_MAXIMUM (255) */ \
+    0x75, 0x08,                    /*   REPORT_SIZE (8) */ \
+    0x95, FEATURE_REPORT_SIZE,     /*   REPORT_COUNT */ \
+    0x09, 0x02,                    /*   USAGE (Vendor Usage 2) */ \
+    0xb1, 0x02,                    /*   FEATURE (Data,Var,Abs) */ \
+    0xc0                           /* END_COLLECTION */
 
 static const uint8_t PROGMEM gamepad_hid_report_desc[] = {
+    PLAYER_COLLECTIONS(GAMEPAD_COLLECTION),
+    FEATURE_COLLECTION
+};
+
+// PS3 arcade stick layout: 13 buttons, the dpad on a hat switch and
+// four centred sticks, as on common licensed sticks
+#define PS3_COLLECTION(id) \
+    0x05, 0x01,                    /* USAGE_PAGE (Generic Desktop) */ \
+    0x09, 0x05,                    /* USAGE (Game Pad) */ \
+    0xa1, 0x01,                    /* COLLECTION (Application) */ \
+    GAMEPAD_REPORT_ID(id) \
+    0x15, 0x00,                    /*   LOGICAL_MINIMUM (0) */ \
+    0x25, 0x01,                    /*   LOGICAL_MAXIMUM (1) */ \
+    0x35, 0x00,                    /*   PHYSICAL_MINIMUM (0) */ \
+    0x45, 0x01,                    /*   PHYSICAL_MAXIMUM (1) */ \
+    0x75, 0x01,                    /*   REPORT_SIZE (1) */ \
+    0x95, 0x0d,                    /*   REPORT_COUNT (13) */ \
+    0x05, 0x09,                    /*   USAGE_PAGE (Button) */ \
+    0x19, 0x01,                    /*   USAGE_MINIMUM (Button 1) */ \
+    0x29, 0x0d,                    /*   USAGE_MAXIMUM (Button 13) */ \
+    0x81, 0x02,                    /*   INPUT (Data,Var,Abs) */ \
+    0x95, 0x03,                    /*   REPORT_COUNT (3) */ \
+    0x81, 0x01,                    /*   INPUT (Cnst,Ary,Abs) */ \
+    0x05, 0x01,                    /*   USAGE_PAGE (Generic Desktop) */ \
+    0x25, 0x07,                    /*   LOGICAL_MAXIMUM (7) */ \
+    0x46, 0x3b, 0x01,              /*   PHYSICAL_MAXIMUM (315) */ \
+    0x75, 0x04,                    /*   REPORT_SIZE (4) */ \
+    0x95, 0x01,                    /*   REPORT_COUNT (1) */ \
+    0x65, 0x14,                    /*   UNIT (Eng Rot:Angular Pos) */ \
+    0x09, 0x39,                    /*   USAGE (Hat switch) */ \
+    0x81, 0x42,                    /*   INPUT (Data,Var,Abs,Null) */ \
+    0x65, 0x00,                    /*   UNIT (None) */ \
+    0x95, 0x01,                    /*   REPORT_COUNT (1) */ \
+    0x81, 0x01,                    /*   INPUT (Cnst,Ary,Abs) */ \
+    0x26, 0xff, 0x00,              /*   LOGICAL_MAXIMUM (255) */ \
+    0x46, 0xff, 0x00,              /*   PHYSICAL_MAXIMUM (255) */ \
+    0x09, 0x30,                    /*   USAGE (X) */ \
+    0x09, 0x31,                    /*   USAGE (Y) */ \
+    0x09, 0x32,                    /*   USAGE (Z) */ \
+    0x09, 0x35,                    /*   USAGE (Rz) */ \
+    0x75, 0x08,                    /*   REPORT_SIZE (8) */ \
+    0x95, 0x04,                    /*   REPORT_COUNT (4) */ \
+    0x81, 0x02,                    /*   INPUT (Data,Var,Abs) */ \
+    0xc0                           /* END_COLLECTION */
+
+static const uint8_t PROGMEM ps3_hid_report_desc[] = {
+    PLAYER_COLLECTIONS(PS3_COLLECTION)
+};
+
+// Keyboard with a modifier byte and one bit per key up to
+// KEYBOARD_BITMAP_KEYS, so any number of keys can be held at once.
+// Hosts using the boot protocol get the standard 8 byte report
+// instead.
+static const uint8_t PROGMEM keyboard_hid_report_desc[] = {
     0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x15, 0x00,                    // LOGICAL_MINIMUM (0)
-    0x09, 0x04,                    // USAGE (Joystick)
+    0x09, 0x06,                    // USAGE (Keyboard)
     0xa1, 0x01,                    // COLLECTION (Application)
-    0x05, 0x01,                    //   USAGE_PAGE (Generic Desktop)
-    0x75, 0x08,                    //   REPORT_SIZE (8)
-    0x26, 0xff, 0x00,              //   LOGICAL_MAXIMUM (255)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x19, 0xe0,                    //   USAGE_MINIMUM (Left Control)
+    0x29, 0xe7,                    //   USAGE_MAXIMUM (Right GUI)
     0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x19, 0x00,                    //   USAGE_MINIMUM (0)
+    0x29, KEYBOARD_BITMAP_KEYS-1,  //   USAGE_MAXIMUM
+    0x95, KEYBOARD_BITMAP_KEYS,    //   REPORT_COUNT
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0                           // END_COLLECTION
+};
+
+#ifdef GENESIS_MEGA_MOUSE
+// Mouse with 4 buttons (left, right, middle, Start) and 16-bit
+// relative X and Y
+static const uint8_t PROGMEM mouse_hid_report_desc[] = {
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
     0x09, 0x01,                    //   USAGE (Pointer)
     0xa1, 0x00,                    //   COLLECTION (Physical)
+    0x05, 0x09,                    //     USAGE_PAGE (Button)
+    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
+    0x29, 0x04,                    //     USAGE_MAXIMUM (Button 4)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //     REPORT_SIZE (1)
+    0x95, 0x04,                    //     REPORT_COUNT (4)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x75, 0x04,                    //     REPORT_SIZE (4)
+    0x95, 0x01,                    //     REPORT_COUNT (1)
+    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
+    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
     0x09, 0x30,                    //     USAGE (X)
     0x09, 0x31,                    //     USAGE (Y)
+    0x16, 0x01, 0x80,              //     LOGICAL_MINIMUM (-32767)
+    0x26, 0xff, 0x7f,              //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //     REPORT_SIZE (16)
     0x95, 0x02,                    //     REPORT_COUNT (2)
-    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
     0xc0,                          //   END_COLLECTION
-    0x05, 0x09,                    //   USAGE_PAGE (Button)
-    0x19, 0x01,                    //   USAGE_MINIMUM (Button 1)
-    0x29, 0x0a,                    //   USAGE_MAXIMUM (Button 10)
-    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
-    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
-    0x75, 0x01,                    //   REPORT_SIZE (1)
-    0x95, 0x0a,                    //   REPORT_COUNT (10)
-    0x55, 0x00,                    //   UNIT_EXPONENT (0)
-    0x65, 0x00,                    //   UNIT (None)
-    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
-    0x95, 0x01,                    //   REPORT_COUNT (1)
-    0x75, 0x06,                    //   REPORT_SIZE (6)
-    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
     0xc0                           // END_COLLECTION
 };
+#endif
 
 
-#define CONFIG1_DESC_SIZE       (9+9+9+7)
-#define GAMEPAD_HID_DESC_OFFSET (9+9)
-static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
-    // configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
-    9,                  // bLength;
-    2,                  // bDescriptorType;
-    LSB(CONFIG1_DESC_SIZE),         // wTotalLength
-    MSB(CONFIG1_DESC_SIZE),
-    1,                  // bNumInterfaces
-    1,                  // bConfigurationValue
-    0,                  // iConfiguration
-    0x80,                   // bmAttributes
-    50,                 // bMaxPower
-    // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
-    9,                  // bLength
-    4,                  // bDescriptorType
-    GAMEPAD_INTERFACE,          // bInterfaceNumber
-    0,                  // bAlternateSetting
-    1,                  // bNumEndpoints
-    0x03,                   // bInterfaceClass (0x03 = HID)
-    0x00,                   // bInterfaceSubClass (0x00 = No Boot)
-    0x00,                   // bInterfaceProtocol (0x00 = No Protocol)
-    0,                  // iInterface
-    // HID interface descriptor, HID 1.11 spec, section 6.2.1
-    9,                  // bLength
-    0x21,                   // bDescriptorType
-    0x11, 0x01,             // bcdHID
-    0,                  // bCountryCode
-    1,                  // bNumDescriptors
-    0x22,                   // bDescriptorType
-    sizeof(gamepad_hid_report_desc),    // wDescriptorLength
-    0,
-    // endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13
-    7,                  // bLength
-    5,                  // bDescriptorType
-    GAMEPAD_ENDPOINT | 0x80,        // bEndpointAddress
-    0x03,                   // bmAttributes (0x03=intr)
-    GAMEPAD_SIZE, 0,            // wMaxPacketSize
-    10                  // bInterval
+// Interface, HID and endpoint descriptors for HID interface n, with
+// the given endpoint
+#define HID_IF_DESC_SIZE    (9+9+7)
+#define HID_EP_IF_DESC(n, endpoint, size, interval, report_desc, subclass, protocol) \
+    /* interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12 */ \
+    9,                  /* bLength */ \
+    4,                  /* bDescriptorType */ \
+    GAMEPAD_INTERFACE + (n),    /* bInterfaceNumber */ \
+    0,                  /* bAlternateSetting */ \
+    1,                  /* bNumEndpoints */ \
+    0x03,                   /* bInterfaceClass (0x03 = HID) */ \
+    (subclass),             /* bInterfaceSubClass (0x01 = Boot) */ \
+    (protocol),             /* bInterfaceProtocol (0x01 = Keyboard) */ \
+    0,                  /* iInterface */ \
+    /* HID interface descriptor, HID 1.11 spec, section 6.2.1 */ \
+    9,                  /* bLength */ \
+    0x21,                   /* bDescriptorType */ \
+    0x11, 0x01,             /* bcdHID */ \
+    0,                  /* bCountryCode */ \
+    1,                  /* bNumDescriptors */ \
+    0x22,                   /* bDescriptorType */ \
+    LSB(sizeof(report_desc)),   /* wDescriptorLength */ \
+    MSB(sizeof(report_desc)), \
+    /* endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13 */ \
+    7,                  /* bLength */ \
+    5,                  /* bDescriptorType */ \
+    (endpoint) | 0x80,          /* bEndpointAddress */ \
+    0x03,                   /* bmAttributes (0x03=intr) */ \
+    (size), 0,              /* wMaxPacketSize */ \
+    (interval)              /* bInterval */
+
+// The gamepad endpoints' bInterval is replaced by usb_gamepad_interval
+#define HID_IF_DESC(n, report_desc, subclass, protocol) \
+    HID_EP_IF_DESC(n, GAMEPAD_ENDPOINT + (n), GAMEPAD_SIZE, \
+        GAMEPAD_INTERVAL, report_desc, subclass, protocol)
+
+#define GAMEPAD_IF_DESC(n)  HID_IF_DESC(n, gamepad_hid_report_desc, 0, 0)
+#define PS3_IF_DESC(n)      HID_IF_DESC(n, ps3_hid_report_desc, 0, 0)
+
+// Interface and endpoint descriptors for a vendor-specific interface
+// n with a single interrupt endpoint
+#define VENDOR_IF_DESC_SIZE (9+7)
+#define VENDOR_IF_DESC(n, address, size) \
+    /* interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12 */ \
+    9,                  /* bLength */ \
+    4,                  /* bDescriptorType */ \
+    (n),                    /* bInterfaceNumber */ \
+    0,                  /* bAlternateSetting */ \
+    1,                  /* bNumEndpoints */ \
+    0xFF,                   /* bInterfaceClass (0xFF = Vendor) */ \
+    0,                  /* bInterfaceSubClass */ \
+    0,                  /* bInterfaceProtocol */ \
+    0,                  /* iInterface */ \
+    /* endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13 */ \
+    7,                  /* bLength */ \
+    5,                  /* bDescriptorType */ \
+    (address),              /* bEndpointAddress */ \
+    0x03,                   /* bmAttributes (0x03=intr) */ \
+    (size), 0,              /* wMaxPacketSize */ \
+    1                   /* bInterval */
+
+// XInput interface: vendor class, with the subclass and protocol of
+// an Xbox 360 pad and the undocumented class descriptor it carries,
+// as xpad and Windows' driver look for. Reports go out on the first
+// gamepad endpoint; the OUT endpoint takes rumble and LED commands.
+#define XINPUT_IF_DESC_SIZE (9+17+7+7)
+#define XINPUT_IF_DESC \
+    /* interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12 */ \
+    9,                  /* bLength */ \
+    4,                  /* bDescriptorType */ \
+    GAMEPAD_INTERFACE,          /* bInterfaceNumber */ \
+    0,                  /* bAlternateSetting */ \
+    2,                  /* bNumEndpoints */ \
+    0xFF,                   /* bInterfaceClass (0xFF = Vendor) */ \
+    0x5D,                   /* bInterfaceSubClass (Xbox 360 pad) */ \
+    0x01,                   /* bInterfaceProtocol (Xbox 360 pad) */ \
+    0,                  /* iInterface */ \
+    /* Xbox 360 pad class descriptor, as sent by a wired pad */ \
+    17,                 /* bLength */ \
+    0x21,                   /* bDescriptorType */ \
+    0x00, 0x01, 0x01, 0x25, \
+    GAMEPAD_ENDPOINT | 0x80,        /* IN endpoint */ \
+    XINPUT_REPORT_SIZE,         /* IN report size */ \
+    0x00, 0x00, 0x00, 0x00, 0x13, \
+    XINPUT_OUT_ENDPOINT,            /* OUT endpoint */ \
+    0x08, 0x00, 0x00, \
+    /* endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13 */ \
+    7,                  /* bLength */ \
+    5,                  /* bDescriptorType */ \
+    GAMEPAD_ENDPOINT | 0x80,        /* bEndpointAddress */ \
+    0x03,                   /* bmAttributes (0x03=intr) */ \
+    XINPUT_SIZE, 0,             /* wMaxPacketSize */ \
+    1,                  /* bInterval */ \
+    /* endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13 */ \
+    7,                  /* bLength */ \
+    5,                  /* bDescriptorType */ \
+    XINPUT_OUT_ENDPOINT,            /* bEndpointAddress */ \
+    0x03,                   /* bmAttributes (0x03=intr) */ \
+    XINPUT_OUT_SIZE, 0,         /* wMaxPacketSize */ \
+    8                   /* bInterval */
+
+#ifdef GENESIS_MEGA_MOUSE
+#define MOUSE_IF_DESC(n)    , HID_EP_IF_DESC(n, MOUSE_ENDPOINT, MOUSE_SIZE, \
+    MOUSE_INTERVAL, mouse_hid_report_desc, 0, 0)
+#else
+#define MOUSE_IF_DESC(n)
+#endif
+#ifdef EVENT_LOG
+#define EVENT_IF_DESC(n)    , VENDOR_IF_DESC(n, EVENT_ENDPOINT | 0x80, EVENT_SIZE)
+#else
+#define EVENT_IF_DESC(n)
+#endif
+#ifdef PLAYBACK
+#define PLAYBACK_IF_DESC(n) , VENDOR_IF_DESC(n, PLAYBACK_ENDPOINT, PLAYBACK_SIZE)
+#else
+#define PLAYBACK_IF_DESC(n)
+#endif
+
+// Mouse and vendor-specific interfaces following the given number of
+// the personality's own HID interfaces
+#define VENDOR_INTERFACES   (EVENT_INTERFACES + PLAYBACK_INTERFACES)
+#define EXTRA_INTERFACES    (MOUSE_INTERFACES + VENDOR_INTERFACES)
+#define EXTRA_IF_DESCS(interfaces) \
+    MOUSE_IF_DESC(interfaces) \
+    EVENT_IF_DESC(GAMEPAD_INTERFACE + (interfaces) + MOUSE_INTERFACES) \
+    PLAYBACK_IF_DESC(GAMEPAD_INTERFACE + (interfaces) + MOUSE_INTERFACES \
+        + EVENT_INTERFACES)
+
+// configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
+#define CONFIG_DESC_SIZE(interfaces)    (9 + ((interfaces) + MOUSE_INTERFACES) \
+    * HID_IF_DESC_SIZE + VENDOR_INTERFACES * VENDOR_IF_DESC_SIZE)
+#define CONFIG_DESC_HEADER(interfaces) \
+    CONFIG_DESC_HEADER_SIZE(CONFIG_DESC_SIZE(interfaces), interfaces)
+#define CONFIG_DESC_HEADER_SIZE(size, interfaces) \
+    9,                  /* bLength */ \
+    2,                  /* bDescriptorType */ \
+    LSB(size),              /* wTotalLength */ \
+    MSB(size), \
+    (interfaces) + EXTRA_INTERFACES,    /* bNumInterfaces */ \
+    1,                  /* bConfigurationValue */ \
+    0,                  /* iConfiguration */ \
+    0xA0,                   /* bmAttributes (remote wakeup) */ \
+    50                  /* bMaxPower */
+
+#define HID_DESC_OFFSET(n)  (9 + (n) * HID_IF_DESC_SIZE + 9)
+#define INTERVAL_OFFSET(n)  (9 + (n) * HID_IF_DESC_SIZE + 9+9+6)
+
+static const uint8_t PROGMEM config1_descriptor[CONFIG_DESC_SIZE(GAMEPAD_INTERFACES)] = {
+    CONFIG_DESC_HEADER(GAMEPAD_INTERFACES),
+    GAMEPAD_IF_DESC(0)
+#if GAMEPAD_INTERFACES > 1
+    , GAMEPAD_IF_DESC(1)
+#endif
+#if GAMEPAD_INTERFACES > 2
+    , GAMEPAD_IF_DESC(2)
+#endif
+#if GAMEPAD_INTERFACES > 3
+    , GAMEPAD_IF_DESC(3)
+#endif
+    EXTRA_IF_DESCS(GAMEPAD_INTERFACES)
 };
 
+static const uint8_t PROGMEM ps3_config1_descriptor[CONFIG_DESC_SIZE(GAMEPAD_INTERFACES)] = {
+    CONFIG_DESC_HEADER(GAMEPAD_INTERFACES),
+    PS3_IF_DESC(0)
+#if GAMEPAD_INTERFACES > 1
+    , PS3_IF_DESC(1)
+#endif
+#if GAMEPAD_INTERFACES > 2
+    , PS3_IF_DESC(2)
+#endif
+#if GAMEPAD_INTERFACES > 3
+    , PS3_IF_DESC(3)
+#endif
+    EXTRA_IF_DESCS(GAMEPAD_INTERFACES)
+};
+
+static const uint8_t PROGMEM keyboard_config1_descriptor[CONFIG_DESC_SIZE(KEYBOARD_INTERFACES)] = {
+    CONFIG_DESC_HEADER(KEYBOARD_INTERFACES),
+    HID_IF_DESC(0, keyboard_hid_report_desc, 0x01, 0x01)
+    EXTRA_IF_DESCS(KEYBOARD_INTERFACES)
+};
+
+// The XInput interface replaces the first HID one
+#define XINPUT_CONFIG_DESC_SIZE (CONFIG_DESC_SIZE(0) + XINPUT_IF_DESC_SIZE)
+#define XINPUT_HID_DESC_OFFSET  (9 + XINPUT_IF_DESC_SIZE + 9)
+
+#ifdef USB_XINPUT
+static const uint8_t PROGMEM xinput_config1_descriptor[XINPUT_CONFIG_DESC_SIZE] = {
+    CONFIG_DESC_HEADER_SIZE(XINPUT_CONFIG_DESC_SIZE, XINPUT_INTERFACES),
+    XINPUT_IF_DESC
+    EXTRA_IF_DESCS(XINPUT_INTERFACES)
+};
+
+// Microsoft extended compat ID descriptor, which has Windows load its
+// Xbox 360 pad driver (XUSB) for the XInput interface
+static const uint8_t PROGMEM xinput_compat_id[] = {
+    40, 0, 0, 0,                // dwLength
+    0x00, 0x01,                 // bcdVersion
+    0x04, 0x00,                 // wIndex (extended compat ID)
+    1,                          // bCount
+    0, 0, 0, 0, 0, 0, 0,        // reserved
+    GAMEPAD_INTERFACE,          // bFirstInterfaceNumber
+    0x01,                       // reserved
+    'X', 'U', 'S', 'B', '1', '0', 0, 0, // compatibleID
+    0, 0, 0, 0, 0, 0, 0, 0,     // subCompatibleID
+    0, 0, 0, 0, 0, 0            // reserved
+};
+#endif
+
 // If you're desperate for a little extra code memory, these strings
 // can be completely removed if iManufacturer, iProduct, iSerialNumber
 // in the device desciptor are changed to zeros.
 struct usb_string_descriptor_struct {
     uint8_t bLength;
     uint8_t bDescriptorType;
-    int16_t wString[];
+    wchar_t wString[];
 };
 static const struct usb_string_descriptor_struct PROGMEM string0 = {
     4,
@@ -221,22 +827,91 @@ static const struct usb_string_descriptor_struct PROGMEM string2 = {
     3,
     STR_PRODUCT
 };
+#ifdef USB_XINPUT
+// Microsoft OS string descriptor, giving the vendor request for
+// xinput_compat_id in its last character
+static const struct usb_string_descriptor_struct PROGMEM string_ms_os = {
+    18,
+    3,
+    {'M', 'S', 'F', 'T', '1', '0', '0', MS_OS_VENDOR_CODE}
+};
+#endif
+
+// Personalities each descriptor is served for, one bit per
+// enum usb_personality
+#define FOR_GAMEPAD     (1 << USB_PERSONALITY_GAMEPAD)
+#define FOR_PS3         (1 << USB_PERSONALITY_PS3)
+#define FOR_KEYBOARD    (1 << USB_PERSONALITY_KEYBOARD)
+#define FOR_XINPUT      (1 << USB_PERSONALITY_XINPUT)
+#define FOR_ALL         (FOR_GAMEPAD | FOR_PS3 | FOR_KEYBOARD | FOR_XINPUT)
+
+// HID and report descriptors for interface n of a personality
+#define HID_DESC_ENTRIES(n, config, report_desc, who) \
+    {0x2100, GAMEPAD_INTERFACE+(n), (config)+HID_DESC_OFFSET(n), 9, who}, \
+    {0x2200, GAMEPAD_INTERFACE+(n), report_desc, sizeof(report_desc), who}
+
+#ifdef GENESIS_MEGA_MOUSE
+#ifdef USB_XINPUT
+#define XINPUT_MOUSE_DESC_ENTRIES \
+    {0x2100, GAMEPAD_INTERFACE+XINPUT_INTERFACES, xinput_config1_descriptor+XINPUT_HID_DESC_OFFSET, 9, FOR_XINPUT}, \
+    {0x2200, GAMEPAD_INTERFACE+XINPUT_INTERFACES, mouse_hid_report_desc, sizeof(mouse_hid_report_desc), FOR_XINPUT},
+#else
+#define XINPUT_MOUSE_DESC_ENTRIES
+#endif
+// The mouse interface follows each personality's own interfaces
+#define MOUSE_DESC_ENTRIES \
+    HID_DESC_ENTRIES(GAMEPAD_INTERFACES, config1_descriptor, mouse_hid_report_desc, FOR_GAMEPAD), \
+    HID_DESC_ENTRIES(GAMEPAD_INTERFACES, ps3_config1_descriptor, mouse_hid_report_desc, FOR_PS3), \
+    HID_DESC_ENTRIES(KEYBOARD_INTERFACES, keyboard_config1_descriptor, mouse_hid_report_desc, FOR_KEYBOARD), \
+    XINPUT_MOUSE_DESC_ENTRIES
+#else
+#define MOUSE_DESC_ENTRIES
+#endif
+
+#define GAMEPAD_DESC_ENTRIES(n) \
+    HID_DESC_ENTRIES(n, config1_descriptor, gamepad_hid_report_desc, FOR_GAMEPAD), \
+    HID_DESC_ENTRIES(n, ps3_config1_descriptor, ps3_hid_report_desc, FOR_PS3)
 
 // This table defines which descriptor data is sent for each specific
-// request from the host (in wValue and wIndex).
+// request from the host (in wValue and wIndex), and for which
+// personalities.
 static const struct descriptor_list_struct {
     uint16_t    wValue;
     uint16_t    wIndex;
     const uint8_t   *addr;
-    uint8_t     length;
+    uint16_t    length;
+    uint8_t     personalities;
 } PROGMEM descriptor_list[] = {
-    {0x0100, 0x0000, device_descriptor, sizeof(device_descriptor)},
-    {0x0200, 0x0000, config1_descriptor, sizeof(config1_descriptor)},
-    {0x2100, GAMEPAD_INTERFACE, config1_descriptor+GAMEPAD_HID_DESC_OFFSET, 9},
-    {0x2200, GAMEPAD_INTERFACE, gamepad_hid_report_desc, sizeof(gamepad_hid_report_desc)},
-    {0x0300, 0x0000, (const uint8_t *)&string0, 4},
-    {0x0301, 0x0409, (const uint8_t *)&string1, sizeof(STR_MANUFACTURER)},
-    {0x0302, 0x0409, (const uint8_t *)&string2, sizeof(STR_PRODUCT)}
+    {0x0100, 0x0000, device_descriptor, sizeof(device_descriptor), FOR_GAMEPAD},
+    {0x0100, 0x0000, ps3_device_descriptor, sizeof(ps3_device_descriptor), FOR_PS3},
+    {0x0100, 0x0000, keyboard_device_descriptor, sizeof(keyboard_device_descriptor), FOR_KEYBOARD},
+#ifdef USB_XINPUT
+    {0x0100, 0x0000, xinput_device_descriptor, sizeof(xinput_device_descriptor), FOR_XINPUT},
+#endif
+    {0x0200, 0x0000, config1_descriptor, sizeof(config1_descriptor), FOR_GAMEPAD},
+    {0x0200, 0x0000, ps3_config1_descriptor, sizeof(ps3_config1_descriptor), FOR_PS3},
+    {0x0200, 0x0000, keyboard_config1_descriptor, sizeof(keyboard_config1_descriptor), FOR_KEYBOARD},
+#ifdef USB_XINPUT
+    {0x0200, 0x0000, xinput_config1_descriptor, sizeof(xinput_config1_descriptor), FOR_XINPUT},
+#endif
+    HID_DESC_ENTRIES(0, keyboard_config1_descriptor, keyboard_hid_report_desc, FOR_KEYBOARD),
+    GAMEPAD_DESC_ENTRIES(0),
+#if GAMEPAD_INTERFACES > 1
+    GAMEPAD_DESC_ENTRIES(1),
+#endif
+#if GAMEPAD_INTERFACES > 2
+    GAMEPAD_DESC_ENTRIES(2),
+#endif
+#if GAMEPAD_INTERFACES > 3
+    GAMEPAD_DESC_ENTRIES(3),
+#endif
+    MOUSE_DESC_ENTRIES
+    {0x0300, 0x0000, (const uint8_t *)&string0, 4, FOR_ALL},
+    {0x0301, 0x0409, (const uint8_t *)&string1, sizeof(STR_MANUFACTURER), FOR_ALL},
+    {0x0302, 0x0409, (const uint8_t *)&string2, sizeof(STR_PRODUCT), FOR_ALL},
+#ifdef USB_XINPUT
+    {0x03EE, 0x0000, (const uint8_t *)&string_ms_os, 18, FOR_XINPUT},
+#endif
 };
 #define NUM_DESC_LIST (sizeof(descriptor_list)/sizeof(struct descriptor_list_struct))
 
@@ -250,6 +925,46 @@ static const struct descriptor_list_struct {
 // zero when we are not configured, non-zero when enumerated
 static volatile uint8_t usb_configuration = 0;
 
+// set while the bus is suspended and the USB clock stopped
+volatile uint8_t usb_suspended = 0;
+
+// set while the host allows us to wake it from suspend
+static volatile uint8_t usb_remote_wakeup_enabled = 0;
+
+// bInterval reported in the gamepad endpoint descriptor
+uint8_t usb_gamepad_interval = GAMEPAD_INTERVAL;
+
+// descriptors and report format presented to the host
+uint8_t usb_personality = USB_PERSONALITY_GAMEPAD;
+
+static const uint8_t PROGMEM keyboard_button_keys[] = {
+    KEYBOARD_BUTTON_KEYS
+};
+
+// Most keys the keyboard personality can hold at once: every button
+// and one key per dpad axis
+#define KEYBOARD_MAX_KEYS   (sizeof(keyboard_button_keys) + 2)
+
+// Boot protocol key code for more keys held than the report holds
+#define KEY_ERROR_ROLLOVER  0x01
+
+#ifdef USB_XINPUT
+static const uint16_t PROGMEM xinput_button_bits[] = {
+    XINPUT_BUTTON_BITS
+};
+#endif
+
+// PS3 hat switch value for each dpad position, indexed by the
+// Y and X axis positions from axis_position()
+static const uint8_t PROGMEM ps3_hat[3][3] = {
+    { 7, 0, 1 },        // up-left, up, up-right
+    { 6, 8, 2 },        // left, centred (null), right
+    { 5, 4, 3 }         // down-left, down, down-right
+};
+
+// Value of the PS3 sticks, which stay centred
+#define PS3_STICK_CENTRE    0x80
+
 static const gamepad_state_t PROGMEM gamepad_idle_state = {
     .xAxis = 127, .yAxis = 127
     /* All other fields will be set to zero per C99 standards */
@@ -260,8 +975,49 @@ static uint8_t gamepad_idle_config = 0;
 // protocol setting from the host.  We use exactly the same report
 // either way, so this variable only stores the setting since we
 // are required to be able to report which setting is in use.
+// The HID spec has it go back to report protocol (1) whenever the
+// device is reset or configured.
 static uint8_t gamepad_protocol = 1;
 
+// Timing of the start-of-frame and gamepad endpoint polls, used
+// to phase-lock pad scans to the host
+volatile uint16_t usb_sof_time;
+volatile uint8_t usb_sof_frame;
+volatile uint8_t usb_poll_frame;
+volatile uint16_t usb_poll_offset;
+volatile uint8_t usb_poll_interval = 0;
+volatile uint16_t usb_gamepad_report_age;
+volatile uint8_t usb_settings_changed = 0;
+
+// Sample time of the report waiting in the endpoint bank, if any
+static uint16_t gamepad_bank_sample_time;
+static volatile uint8_t gamepad_bank_loaded = 0;
+
+// Latest gamepad_state published by usb_gamepad_send(), double
+// buffered: main() only writes the buffer that isn't mailbox_latest,
+// and the interrupts only read mailbox_latest, so neither ever sees a
+// half-written report.
+static gamepad_state_t mailbox[2][GAMEPAD_PLAYERS];
+static uint16_t mailbox_sample_time[2];
+static uint16_t mailbox_publish_time;
+static volatile uint8_t mailbox_latest = 0;
+
+// One bit per gamepad endpoint whose bank hasn't been loaded from the
+// latest snapshot yet
+static volatile uint8_t mailbox_fresh = 0;
+
+// Reports loaded for each player, sent (modulo 256) in the generic
+// gamepad report so the host can spot lost reports
+static uint8_t gamepad_sequence[GAMEPAD_PLAYERS];
+
+#ifdef GENESIS_MEGA_MOUSE
+// Mouse motion not yet loaded for the host, the buttons last set, and
+// whether either has changed since the mouse bank was last loaded
+static int16_t mouse_dx, mouse_dy;
+static uint8_t mouse_buttons;
+static volatile uint8_t mouse_fresh = 0;
+#endif
+
 /**************************************************************************
  *
  *  Public Functions - these are the API intended for the user
@@ -277,51 +1033,422 @@ void usb_init(void) {
     USB_CONFIG();               // start USB clock
     UDCON = 0;              // enable attach resistor
     usb_configuration = 0;
-    UDIEN = (1<<EORSTE)|(1<<SOFE);
+    // A keyboard is only worth using over a remapper if it is
+    // polled as often as possible, and XInput pads always are
+    if (usb_personality == USB_PERSONALITY_KEYBOARD
+      || usb_personality == USB_PERSONALITY_XINPUT)
+        usb_gamepad_interval = 1;
+    UDIEN = (1<<EORSTE)|(1<<SOFE)|(1<<SUSPE);
     sei();
 }
 
+// Restart the PLL and USB clock after a suspend. Call with interrupts
+// disabled.
+static void usb_clock_resume(void) {
+    PLL_CONFIG();
+    while (!(PLLCSR & (1<<PLOCK)));     // wait for PLL lock
+    USBCON &= ~(1<<FRZCLK);
+    UDIEN = (UDIEN & ~(1<<WAKEUPE)) | (1<<SUSPE);
+    usb_suspended = 0;
+}
+
+// Wake the host from suspend, if it has allowed us to
+int8_t usb_remote_wakeup(void) {
+    uint8_t intr_state;
+
+    intr_state = SREG;
+    cli();
+    if (!usb_suspended || !usb_remote_wakeup_enabled) {
+        SREG = intr_state;
+        return -1;
+    }
+    usb_clock_resume();
+    UDCON |= (1<<RMWKUP);
+    SREG = intr_state;
+    return 0;
+}
+
 // return 0 if the USB is not configured, or the configuration
 // number selected by the HOST
 uint8_t usb_configured(void) {
     return usb_configuration;
 }
 
-gamepad_state_t gamepad_state;
+gamepad_state_t gamepad_state[GAMEPAD_PLAYERS];
+uint16_t gamepad_sample_time;
+
+#ifdef GAMEPAD_MULTI_REPORT
+// Last report sent for each player, and the player sent last
+static gamepad_state_t gamepad_sent[GAMEPAD_PLAYERS];
+static uint8_t gamepad_last_player;
+#endif
 
 inline void usb_gamepad_reset_state(void) {
-    memcpy_P(&gamepad_state, &gamepad_idle_state, sizeof(gamepad_state_t));
+    uint8_t p;
+
+    for (p=0; p<GAMEPAD_PLAYERS; p++) {
+        memcpy_P(&gamepad_state[p], &gamepad_idle_state, sizeof(gamepad_state_t));
+        mailbox[0][p] = gamepad_state[p];
+        mailbox[1][p] = gamepad_state[p];
+    }
 }
 
+// Interfaces presented by the current personality
+static inline uint8_t usb_interfaces(void) {
+    switch (usb_personality) {
+    case USB_PERSONALITY_KEYBOARD:
+        return KEYBOARD_INTERFACES;
+    case USB_PERSONALITY_XINPUT:
+        return XINPUT_INTERFACES;
+    default:
+        return GAMEPAD_INTERFACES;
+    }
+}
+
+// Players reported by the current personality
+static inline uint8_t usb_players(void) {
+    return usb_personality == USB_PERSONALITY_KEYBOARD
+        || usb_personality == USB_PERSONALITY_XINPUT ? 1 : GAMEPAD_PLAYERS;
+}
+
+// Dpad position of an axis: 0 at the low end, 1 centred, 2 at the
+// high end
+static inline uint8_t axis_position(uint8_t axis) {
+    return axis < 64 ? 0 : (axis > 191 ? 2 : 1);
+}
+
+// Generic joystick report: gamepad_state_t as it is
+static inline void gamepad_write(const gamepad_state_t *state) {
+    uint8_t i;
+
+    for (i=0; i<sizeof(gamepad_state_t); i++) {
+        UEDATX = ((const uint8_t*)state)[i];
+    }
+}
+
+// Trailer of the generic gamepad report, for measuring the converter
+// from the host (see tools/polljitter.c): the player's report sequence
+// number, then how long ago the state was sampled, in GAMEPAD_AGE_UNIT
+// timer ticks
+static inline void gamepad_stamp_write(uint8_t player) {
+    uint16_t age = sched_now() - mailbox_sample_time[mailbox_latest];
+
+    age /= GAMEPAD_AGE_UNIT;
+    UEDATX = gamepad_sequence[player];
+    UEDATX = age > 255 ? 255 : age;
+}
+
+// PS3 report: buttons, then the dpad as a hat, then the sticks
+static inline void ps3_write(const gamepad_state_t *state) {
+    uint8_t i;
+
+    UEDATX = LSB(state->buttons);
+    UEDATX = MSB(state->buttons);
+    UEDATX = pgm_read_byte(&ps3_hat[axis_position(state->yAxis)]
+        [axis_position(state->xAxis)]);
+    for (i=0; i<4; i++) {
+        UEDATX = PS3_STICK_CENTRE;
+    }
+}
+
+// List the keys held on a player's gamepad, returning how many
+static uint8_t keyboard_keys(const gamepad_state_t *state, uint8_t *keys) {
+    uint16_t buttons = state->buttons;
+    uint8_t i, key, n = 0;
+
+    for (i=0; i<sizeof(keyboard_button_keys); i++, buttons >>= 1) {
+        key = pgm_read_byte(&keyboard_button_keys[i]);
+        if ((buttons & 1) && key) keys[n++] = key;
+    }
+    i = axis_position(state->xAxis);
+    if (i != 1) keys[n++] = i ? KEY_RIGHT : KEY_LEFT;
+    i = axis_position(state->yAxis);
+    if (i != 1) keys[n++] = i ? KEY_DOWN : KEY_UP;
+    return n;
+}
+
+// Keyboard report: the modifiers, then either the boot protocol's
+// key array or a bitmap of every key
+static inline void keyboard_write(const gamepad_state_t *state) {
+    uint8_t keys[KEYBOARD_MAX_KEYS], bitmap[KEYBOARD_BITMAP_KEYS / 8];
+    uint8_t i, n;
+
+    n = keyboard_keys(state, keys);
+    UEDATX = 0;
+    if (gamepad_protocol == 0) {
+        UEDATX = 0;
+        for (i=0; i<KEYBOARD_BOOT_KEYS; i++) {
+            if (n > KEYBOARD_BOOT_KEYS) UEDATX = KEY_ERROR_ROLLOVER;
+            else UEDATX = i < n ? keys[i] : 0;
+        }
+        return;
+    }
+    memset(bitmap, 0, sizeof(bitmap));
+    for (i=0; i<n; i++) {
+        bitmap[keys[i] >> 3] |= 1 << (keys[i] & 7);
+    }
+    for (i=0; i<sizeof(bitmap); i++) {
+        UEDATX = bitmap[i];
+    }
+}
+
+#ifdef USB_XINPUT
+// XInput report: a message type and length, the buttons and dpad as
+// Xbox buttons, the triggers, then four 16-bit stick axes and
+// padding. Like the PS3 report, the sticks stay centred.
+static inline void xinput_write(const gamepad_state_t *state) {
+    uint16_t buttons = state->buttons, bits = 0;
+    uint8_t i;
+
+    for (i=0; i<sizeof(xinput_button_bits)/2; i++, buttons >>= 1) {
+        if (buttons & 1) bits |= pgm_read_word(&xinput_button_bits[i]);
+    }
+    i = axis_position(state->xAxis);
+    if (i != 1) bits |= i ? XINPUT_DPAD_RIGHT : XINPUT_DPAD_LEFT;
+    i = axis_position(state->yAxis);
+    if (i != 1) bits |= i ? XINPUT_DPAD_DOWN : XINPUT_DPAD_UP;
+
+    UEDATX = 0x00;
+    UEDATX = XINPUT_REPORT_SIZE;
+    UEDATX = LSB(bits);
+    UEDATX = MSB(bits);
+    UEDATX = (state->buttons & XINPUT_LEFT_TRIGGER) ? 255 : 0;
+    UEDATX = (state->buttons & XINPUT_RIGHT_TRIGGER) ? 255 : 0;
+    for (i=6; i<XINPUT_REPORT_SIZE; i++) {
+        UEDATX = 0;
+    }
+}
+#endif
+
+// Write one player's latest published report into the currently
+// selected endpoint bank
+static inline void usb_gamepad_write(uint8_t player) {
+    const gamepad_state_t *state = &mailbox[mailbox_latest][player];
+
+    if (usb_personality == USB_PERSONALITY_KEYBOARD) {
+        keyboard_write(state);
+        return;
+    }
+#ifdef USB_XINPUT
+    if (usb_personality == USB_PERSONALITY_XINPUT) {
+        xinput_write(state);
+        return;
+    }
+#endif
+#ifdef GAMEPAD_MULTI_REPORT
+    UEDATX = player + 1;
+#endif
+    if (usb_personality == USB_PERSONALITY_PS3) {
+        ps3_write(state);
+    } else {
+        gamepad_write(state);
+        gamepad_stamp_write(player);
+    }
+}
+
+#ifdef GAMEPAD_MULTI_REPORT
+// Check whether a player's latest state differs from what was sent
+static inline uint8_t usb_gamepad_changed(uint8_t p) {
+    return memcmp(&mailbox[mailbox_latest][p], &gamepad_sent[p],
+        sizeof(gamepad_state_t)) != 0;
+}
+
+// Pick the player to send next: the first one after the last sent
+// whose state has changed, or simply the next one in turn, so every
+// player is refreshed even if a report is lost.
+static uint8_t usb_gamepad_next_player(void) {
+    uint8_t i, players = usb_players(), p = gamepad_last_player;
+
+    for (i=0; i<players; i++) {
+        if (++p >= players) p = 0;
+        if (usb_gamepad_changed(p)) return p;
+    }
+    p = gamepad_last_player + 1;
+    return (p >= players) ? 0 : p;
+}
+#endif
+
+static void usb_gamepad_load(uint8_t n);
+
+// Publish gamepad_state to the mailbox. This never waits for the
+// host: banks it has already collected are loaded straight away, and
+// the rest from the endpoint interrupt as soon as they are free.
 int8_t usb_gamepad_send(void) {
-    uint8_t intr_state, timeout, i;
+    uint8_t intr_state, n, back = !mailbox_latest;
+    int8_t ret = 0;
+
+    probe_begin(PROBE_PUBLISH);
+    memcpy(mailbox[back], gamepad_state, sizeof(gamepad_state));
+    mailbox_sample_time[back] = gamepad_sample_time;
 
-    if (!usb_configuration) return -1;
     intr_state = SREG;
     cli();
-    UENUM = GAMEPAD_ENDPOINT;
-    timeout = UDFNUML + 50;
-    while (1) {
-        // are we ready to transmit?
-        if (UEINTX & (1<<RWAL)) break;
-        SREG = intr_state;
-        // has the USB gone offline?
-        if (!usb_configuration) return -1;
-        // have we waited too long?
-        if (UDFNUML == timeout) return -1;
-        // get ready to try checking again
-        intr_state = SREG;
-        cli();
-        UENUM = GAMEPAD_ENDPOINT;
+    if (mailbox_fresh & 1) perf.mailbox_dropped++;
+    mailbox_latest = back;
+    mailbox_publish_time = sched_now();
+    // Until configured, just keep the latest state ready for the
+    // first poll
+    if (usb_configuration && !usb_suspended) {
+        mailbox_fresh = (1 << usb_interfaces()) - 1;
+        for (n=0; n<usb_interfaces(); n++) {
+            usb_gamepad_load(n);
+        }
+    } else {
+        ret = -1;
     }
+    SREG = intr_state;
+    probe_end(PROBE_PUBLISH);
+    return ret;
+}
 
-    for (i=0; i<sizeof(gamepad_state_t); i++) {
-        UEDATX = ((uint8_t*)&gamepad_state)[i];
-    }
+#ifdef GENESIS_MEGA_MOUSE
+// Add a motion count to a running total, saturating rather than
+// wrapping around
+static inline int16_t mouse_add(int16_t total, int16_t delta) {
+    int32_t sum = (int32_t)total + delta;
 
+    if (sum > 32767) return 32767;
+    if (sum < -32767) return -32767;
+    return sum;
+}
+
+// Mouse report: buttons, then X and Y motion
+static inline void mouse_write(int16_t dx, int16_t dy) {
+    UEDATX = mouse_buttons;
+    UEDATX = LSB(dx);
+    UEDATX = MSB(dx);
+    UEDATX = LSB(dy);
+    UEDATX = MSB(dy);
+}
+
+// Load the mouse bank with the motion so far, if the bank is free and
+// anything has changed. Call with interrupts disabled.
+static void usb_mouse_load(void) {
+    if (!mouse_fresh) return;
+    UENUM = MOUSE_ENDPOINT;
+    if (!(UEINTX & (1<<RWAL))) return;
+    mouse_write(mouse_dx, mouse_dy);
     UEINTX = 0x3A;
+    mouse_dx = 0;
+    mouse_dy = 0;
+    mouse_fresh = 0;
+}
+
+// Add mouse motion, sending it straight away if the host has
+// collected the last report, or from the interrupt once it has
+void usb_mouse_move(int16_t dx, int16_t dy, uint8_t buttons) {
+    uint8_t intr_state;
+
+    if (!dx && !dy && buttons == mouse_buttons) return;
+    intr_state = SREG;
+    cli();
+    mouse_dx = mouse_add(mouse_dx, dx);
+    mouse_dy = mouse_add(mouse_dy, dy);
+    mouse_buttons = buttons;
+    mouse_fresh = 1;
+    if (usb_configuration && !usb_suspended) usb_mouse_load();
     SREG = intr_state;
-    return 0;
+}
+#endif
+
+uint16_t usb_frame_number(void) {
+    uint8_t high, low;
+
+    do {
+        high = UDFNUMH;
+        low = UDFNUML;
+    } while (high != UDFNUMH);
+    return ((high & 0x07) << 8) | low;
+}
+
+#ifdef EVENT_LOG
+// Send a batch of logged input events, if there are any and the
+// event endpoint has a free bank. This never waits for the host.
+void usb_event_send(void) {
+    static uint8_t sequence = 0;
+    input_event_t events[EVENTS_PER_PACKET];
+    const uint8_t *data;
+    uint8_t intr_state, ready, i, n;
+
+    if (!usb_configuration || usb_suspended) return;
+    intr_state = SREG;
+    cli();
+    UENUM = EVENT_ENDPOINT;
+    ready = UEINTX & (1<<RWAL);
+    SREG = intr_state;
+    if (!ready) return;
+
+    // Only main() fills the bank, so it stays free meanwhile
+    n = event_log_read(events, EVENTS_PER_PACKET);
+    if (n == 0) return;
+    data = (const uint8_t *)events;
+    cli();
+    UENUM = EVENT_ENDPOINT;
+    UEDATX = n;
+    UEDATX = sequence++;
+    UEDATX = LSB(event_log_dropped);
+    UEDATX = MSB(event_log_dropped);
+    for (i=0; i<n * sizeof(input_event_t); i++) {
+        UEDATX = data[i];
+    }
+    UEINTX = 0x3A;
+    SREG = intr_state;
+}
+#endif
+
+#ifdef PLAYBACK
+// Take a packet of playback frames from the host, if one has arrived
+// and there is room for a whole packet. Otherwise it stays in the
+// endpoint, which makes the host wait: that is the flow control.
+void usb_playback_receive(void) {
+    uint16_t frame[GENESIS_NUM_PADS];
+    uint8_t intr_state, flags, len, pad;
+
+    if (!usb_configuration || usb_suspended) return;
+    if (playback_room() < FRAMES_PER_PACKET) return;
+    intr_state = SREG;
+    cli();
+    UENUM = PLAYBACK_ENDPOINT;
+    if (!(UEINTX & (1<<RXOUTI))) {
+        SREG = intr_state;
+        return;
+    }
+    len = UEBCLX;
+    if (len == 0) {
+        UEINTX = 0x6B;
+        SREG = intr_state;
+        return;
+    }
+    flags = UEDATX;
+    len--;
+    if (flags & PLAYBACK_START) playback_start();
+    while (len >= PLAYBACK_FRAME_SIZE) {
+        for (pad=0; pad<GENESIS_NUM_PADS; pad++) {
+            frame[pad] = UEDATX;
+            frame[pad] |= UEDATX << 8;
+        }
+        len -= PLAYBACK_FRAME_SIZE;
+        playback_push(frame);
+    }
+    if (flags & PLAYBACK_END) playback_end();
+    UEINTX = 0x6B;
+    SREG = intr_state;
+}
+#endif
+
+uint8_t usb_gamepad_pending(uint8_t player) {
+    uint8_t intr_state, pending;
+
+    if (!usb_configuration || player >= usb_players()) return 0;
+    intr_state = SREG;
+    cli();
+#ifdef GAMEPAD_MULTI_REPORT
+    pending = usb_gamepad_changed(player);
+#else
+    pending = mailbox_fresh & (1 << player);
+#endif
+    SREG = intr_state;
+    return pending;
 }
 
 /**************************************************************************
@@ -333,9 +1460,24 @@ int8_t usb_gamepad_send(void) {
 ISR(USB_GEN_vect)
 {
     uint8_t intbits;
+    uint16_t now = sched_now();
 
+    probe_begin(PROBE_USB_ISR);
     intbits = UDINT;
+    // Bus activity while suspended. The clock must run again before
+    // the interrupt can be cleared.
+    if ((intbits & (1<<WAKEUPI)) && usb_suspended) {
+        usb_clock_resume();
+    }
     UDINT = 0;
+    if (intbits & (1<<SOFI)) {
+        usb_sof_time = now;
+        usb_sof_frame = UDFNUML;
+        perf.frames++;
+#ifdef PLAYBACK
+        playback_next_frame();
+#endif
+    }
     if (intbits & (1<<EORSTI)) {
         UENUM = 0;
         UECONX = 1;
@@ -343,7 +1485,22 @@ ISR(USB_GEN_vect)
         UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
         UEIENX = (1<<RXSTPE);
         usb_configuration = 0;
+        usb_remote_wakeup_enabled = 0;
+        gamepad_protocol = 1;
+        usb_poll_interval = 0;
+        gamepad_bank_loaded = 0;
+        mailbox_fresh = 0;
     }
+    // No bus activity for 3ms: stop the PLL and USB clock until the
+    // bus wakes up again
+    if ((intbits & (1<<SUSPI)) && !usb_suspended) {
+        UDIEN = (UDIEN & ~(1<<SUSPE)) | (1<<WAKEUPE);
+        USBCON |= (1<<FRZCLK);
+        PLLCSR &= ~(1<<PLLE);
+        usb_suspended = 1;
+    }
+    perf_isr_done(now);
+    probe_end(PROBE_USB_ISR);
 }
 
 // Misc functions to wait for ready and send/receive packets
@@ -355,6 +1512,19 @@ static inline void usb_send_in(void)
 {
     UEINTX = ~(1<<TXINI);
 }
+#ifdef SUPPORT_ENDPOINT_HALT
+// Whether endpoint n (besides 0) is in use, for the halt feature. The
+// XInput OUT endpoint is past MAX_ENDPOINT, and only set up for XInput.
+static inline uint8_t usb_halt_endpoint(uint8_t n)
+{
+    if (n >= 1 && n <= MAX_ENDPOINT) return 1;
+#ifdef USB_XINPUT
+    if (n == XINPUT_OUT_ENDPOINT
+      && usb_personality == USB_PERSONALITY_XINPUT) return 1;
+#endif
+    return 0;
+}
+#endif
 static inline void usb_wait_receive_out(void)
 {
     while (!(UEINTX & (1<<RXOUTI))) ;
@@ -364,24 +1534,242 @@ static inline void usb_ack_out(void)
     UEINTX = ~(1<<RXOUTI);
 }
 
-// USB Endpoint Interrupt - endpoint 0 is handled here.  The
-// other endpoints are manipulated by the user-callable
-// functions, and the start-of-frame interrupt.
+_Static_assert(REMAP_PAGE_SIZE < FEATURE_REPORT_SIZE
+    && sizeof(perf_counters_t) < FEATURE_REPORT_SIZE
+    && CHATTER_PAGE_SIZE < FEATURE_REPORT_SIZE,
+    "feature report pages don't fit");
+
+// Feature report page returned by Get_Report
+static uint8_t feature_page = FEATURE_PAGE_REMAP;
+
+// Send the feature report
+static void feature_report_write(void)
+{
+    uint8_t data[FEATURE_REPORT_SIZE - 1], i;
+
+    memset(data, 0, sizeof(data));
+    if (feature_page == FEATURE_PAGE_PERF) {
+        memcpy(data, &perf, sizeof(perf));
+    } else if (feature_page >= FEATURE_PAGE_CHATTER) {
+        memcpy(data, &debounce_chatter[feature_page - FEATURE_PAGE_CHATTER]
+            [GEN_RIGHT], CHATTER_PAGE_SIZE);
+    } else {
+        data[0] = settings.profile;
+        memcpy(data + 1, &settings.remap[0][0], REMAP_PROFILES * REMAP_BUTTONS);
+    }
+#ifdef GAMEPAD_MULTI_REPORT
+    UEDATX = FEATURE_REPORT_ID;
+#endif
+    UEDATX = feature_page;
+    for (i=0; i<sizeof(data); i++) {
+        UEDATX = data[i];
+    }
+}
+
+// Store a new button remapping from a feature report page, flagging
+// it for main() to apply and save. Returns 0 if it was not valid, in
+// which case settings are left alone.
+static uint8_t remap_page_read(const uint8_t *data)
+{
+    uint8_t i;
+
+    if (data[0] >= REMAP_PROFILES) return 0;
+    for (i=1; i<REMAP_PAGE_SIZE; i++) {
+        if (data[i] > GAMEPAD_NUM_BUTTONS) return 0;
+    }
+    settings.profile = data[0];
+    memcpy(&settings.remap[0][0], data + 1, REMAP_PROFILES * REMAP_BUTTONS);
+    usb_settings_changed = 1;
+    return 1;
+}
+
+// Receive a feature report. Returns 0 if it was not valid.
+static uint8_t feature_report_read(uint16_t wLength)
+{
+    uint8_t report[FEATURE_REPORT_SIZE], i;
+
+    if (!wLength) return 0;
+#ifdef GAMEPAD_MULTI_REPORT
+    wLength--;
+#endif
+    if (wLength != 1 && wLength != FEATURE_REPORT_SIZE) return 0;
+    usb_wait_receive_out();
+#ifdef GAMEPAD_MULTI_REPORT
+    if (UEDATX != FEATURE_REPORT_ID) {
+        usb_ack_out();
+        return 0;
+    }
+#endif
+    for (i=0; i<wLength; i++) {
+        report[i] = UEDATX;
+    }
+    usb_ack_out();
+
+    switch (report[0]) {
+    case FEATURE_PAGE_REMAP:
+        if (wLength > 1 && !remap_page_read(report + 1)) return 0;
+        break;
+    case FEATURE_PAGE_PERF:
+        if (wLength > 1) perf_reset();
+        break;
+    default:
+        if (report[0] < FEATURE_PAGE_CHATTER
+            || report[0] >= FEATURE_PAGE_CHATTER + GENESIS_NUM_PADS) {
+            return 0;
+        }
+        if (wLength > 1) {
+            debounce_clear_chatter(report[0] - FEATURE_PAGE_CHATTER);
+        }
+        break;
+    }
+    feature_page = report[0];
+    return 1;
+}
+
+// Check whether a descriptor byte is one of the gamepad bInterval
+// fields, which are sent from usb_gamepad_interval instead
+static inline uint8_t is_interval_byte(const uint8_t *addr)
+{
+    const uint8_t *cfg;
+    uint8_t n;
+
+    switch (usb_personality) {
+    case USB_PERSONALITY_PS3:
+        cfg = ps3_config1_descriptor;
+        break;
+    case USB_PERSONALITY_KEYBOARD:
+        cfg = keyboard_config1_descriptor;
+        break;
+    case USB_PERSONALITY_XINPUT:
+        // Always 1ms, so it is in the descriptor as it is
+        return 0;
+    default:
+        cfg = config1_descriptor;
+    }
+    for (n=0; n<usb_interfaces(); n++) {
+        if (addr == cfg + INTERVAL_OFFSET(n)) return 1;
+    }
+    return 0;
+}
+
+// Gamepad endpoint bank has been freed, which (when a report was
+// loaded) means the host just polled it. Record when that happened
+// so the scheduler can aim the next scan at the following poll.
+static inline void usb_gamepad_poll_event(uint16_t now)
+{
+    uint8_t frame, interval;
+
+    UENUM = GAMEPAD_ENDPOINT;
+    if (!(UEINTX & (1<<TXINI))) return;
+    UEINTX = ~(1<<TXINI);
+    if (!gamepad_bank_loaded) return;
+    gamepad_bank_loaded = 0;
+
+    usb_gamepad_report_age = now - gamepad_bank_sample_time;
+    frame = UDFNUML;
+    interval = frame - usb_poll_frame;
+    // The bank may have sat empty for a poll or two, so the true
+    // host interval is the shortest gap seen
+    if (interval && interval <= GAMEPAD_MAX_POLL_INTERVAL &&
+      (usb_poll_interval == 0 || interval < usb_poll_interval)) {
+        usb_poll_interval = interval;
+    }
+    usb_poll_frame = frame;
+    usb_poll_offset = now - usb_sof_time;
+}
+
+// Load gamepad endpoint n's bank from the mailbox, if the bank is
+// free and hasn't had the latest snapshot yet. Call with interrupts
+// disabled.
+static void usb_gamepad_load(uint8_t n)
+{
+    uint8_t latest = mailbox_latest;
+#ifdef GAMEPAD_MULTI_REPORT
+    uint8_t p;
+#endif
+
+    if (!(mailbox_fresh & (1 << n))) return;
+    UENUM = GAMEPAD_ENDPOINT + n;
+    if (!(UEINTX & (1<<RWAL))) return;
+    // Loading the bank clears TXINI, so record a poll the interrupt
+    // hasn't got to yet
+    if (n == 0 && (UEINTX & (1<<TXINI))) usb_gamepad_poll_event(sched_now());
+    mailbox_fresh &= ~(1 << n);
+
+    probe_begin(PROBE_REPORT);
+#ifdef GAMEPAD_MULTI_REPORT
+    p = usb_gamepad_next_player();
+    usb_gamepad_write(p);
+    gamepad_sequence[p]++;
+    gamepad_sent[p] = mailbox[latest][p];
+    gamepad_last_player = p;
+    // Other players' changes go in the next free bank
+    for (p=0; p<usb_players(); p++) {
+        if (usb_gamepad_changed(p)) {
+            mailbox_fresh |= 1;
+            break;
+        }
+    }
+#else
+    usb_gamepad_write(n);
+    gamepad_sequence[n]++;
+#endif
+    UEINTX = 0x3A;
+    probe_end(PROBE_REPORT);
+
+    if (n == 0) {
+        gamepad_bank_sample_time = mailbox_sample_time[latest];
+        gamepad_bank_loaded = 1;
+        perf.mailbox_wait += (uint16_t)(sched_now() - mailbox_publish_time);
+    }
+}
+
+// USB Endpoint Interrupt - endpoint 0 is handled here, along with
+// the gamepad endpoints, which are loaded from the mailbox as soon
+// as the host collects their last report.
 //
-ISR(USB_COM_vect)
+static inline void usb_com_handler(void)
 {
     uint8_t intbits;
-    const uint8_t *list;
+    const struct descriptor_list_struct *list;
     const uint8_t *cfg;
-    uint8_t i, n, len, en;
+    uint8_t i, n, en;
+    uint16_t len;
     uint8_t bmRequestType;
     uint8_t bRequest;
     uint16_t wValue;
     uint16_t wIndex;
     uint16_t wLength;
-    uint16_t desc_val;
     const uint8_t *desc_addr;
-    uint8_t desc_length;
+    uint16_t desc_length;
+
+    for (n=0; n<usb_interfaces(); n++) {
+        if (!(UEINT & (1 << (GAMEPAD_ENDPOINT + n)))) continue;
+        if (n == 0) {
+            usb_gamepad_poll_event(sched_now());
+        } else {
+            UENUM = GAMEPAD_ENDPOINT + n;
+            UEINTX = ~(1<<TXINI);
+        }
+        usb_gamepad_load(n);
+    }
+#ifdef GENESIS_MEGA_MOUSE
+    if (UEINT & (1 << MOUSE_ENDPOINT)) {
+        UENUM = MOUSE_ENDPOINT;
+        UEINTX = ~(1<<TXINI);
+        usb_mouse_load();
+    }
+#endif
+#ifdef USB_XINPUT
+    // XInput rumble and LED commands; there is nothing to drive.
+    // Endpoint 5 is only set up for XInput.
+    if (usb_personality == USB_PERSONALITY_XINPUT
+      && (UEINT & (1 << XINPUT_OUT_ENDPOINT))) {
+        UENUM = XINPUT_OUT_ENDPOINT;
+        UEINTX = 0x6B;
+    }
+#endif
+    if (!(UEINT & 1)) return;
 
     UENUM = 0;
     intbits = UEINTX;
@@ -396,30 +1784,22 @@ ISR(USB_COM_vect)
         wLength |= (UEDATX << 8);
         UEINTX = ~((1<<RXSTPI) | (1<<RXOUTI) | (1<<TXINI));
         if (bRequest == GET_DESCRIPTOR) {
-            list = (const uint8_t *)descriptor_list;
-            for (i=0; ; i++) {
+            list = descriptor_list;
+            for (i=0; ; i++, list++) {
                 if (i >= NUM_DESC_LIST) {
                     UECONX = (1<<STALLRQ)|(1<<EPEN);  //stall
                     return;
                 }
-                desc_val = pgm_read_word(list);
-                if (desc_val != wValue) {
-                    list += sizeof(struct descriptor_list_struct);
-                    continue;
-                }
-                list += 2;
-                desc_val = pgm_read_word(list);
-                if (desc_val != wIndex) {
-                    list += sizeof(struct descriptor_list_struct)-2;
-                    continue;
+                if (pgm_read_word(&list->wValue) == wValue
+                  && pgm_read_word(&list->wIndex) == wIndex
+                  && (pgm_read_byte(&list->personalities) & (1 << usb_personality))) {
+                    break;
                 }
-                list += 2;
-                desc_addr = (const uint8_t *)pgm_read_word(list);
-                list += 2;
-                desc_length = pgm_read_byte(list);
-                break;
             }
-            len = (wLength < 256) ? wLength : 255;
+            desc_addr = (const uint8_t *)pgm_read_ptr(&list->addr);
+            desc_length = pgm_read_word(&list->length);
+            // report descriptors for several players can exceed 255
+            len = wLength;
             if (len > desc_length) len = desc_length;
             do {
                 // wait for host ready for IN packet
@@ -430,7 +1810,12 @@ ISR(USB_COM_vect)
                 // send IN packet
                 n = len < ENDPOINT0_SIZE ? len : ENDPOINT0_SIZE;
                 for (i = n; i; i--) {
-                    UEDATX = pgm_read_byte(desc_addr++);
+                    if (is_interval_byte(desc_addr)) {
+                        UEDATX = usb_gamepad_interval;
+                        desc_addr++;
+                    } else {
+                        UEDATX = pgm_read_byte(desc_addr++);
+                    }
                 }
                 len -= n;
                 usb_send_in();
@@ -445,6 +1830,7 @@ ISR(USB_COM_vect)
         }
         if (bRequest == SET_CONFIGURATION && bmRequestType == 0) {
             usb_configuration = wValue;
+            gamepad_protocol = 1;
             usb_send_in();
             cfg = endpoint_config_table;
             for (i=1; i<5; i++) {
@@ -456,8 +1842,39 @@ ISR(USB_COM_vect)
                     UECFG1X = pgm_read_byte(cfg++);
                 }
             }
-            UERST = 0x1E;
+#ifdef USB_XINPUT
+            if (usb_personality == USB_PERSONALITY_XINPUT) {
+                UENUM = XINPUT_OUT_ENDPOINT;
+                UECONX = 1;
+                UECFG0X = EP_TYPE_INTERRUPT_OUT;
+                UECFG1X = EP_SIZE(XINPUT_OUT_SIZE) | EP_SINGLE_BUFFER;
+                UEIENX = (1<<RXOUTE);
+            }
+#endif
+            UERST = 0x3E;
             UERST = 0;
+            for (n=0; n<usb_interfaces(); n++) {
+                UENUM = GAMEPAD_ENDPOINT + n;
+                UEIENX = (1<<TXINE);
+            }
+            usb_poll_interval = 0;
+            gamepad_bank_loaded = 0;
+            // Load the state scanned during enumeration, so the very
+            // first poll already has it
+            mailbox_fresh = (1 << usb_interfaces()) - 1;
+            for (n=0; n<usb_interfaces(); n++) {
+                usb_gamepad_load(n);
+            }
+#ifdef GENESIS_MEGA_MOUSE
+            // Motion from before configuration is dropped, but held
+            // buttons are sent
+            UENUM = MOUSE_ENDPOINT;
+            UEIENX = (1<<TXINE);
+            mouse_dx = 0;
+            mouse_dy = 0;
+            mouse_fresh = 1;
+            usb_mouse_load();
+#endif
             return;
         }
         if (bRequest == GET_CONFIGURATION && bmRequestType == 0x80) {
@@ -470,9 +1887,10 @@ ISR(USB_COM_vect)
         if (bRequest == GET_STATUS) {
             usb_wait_in_ready();
             i = 0;
+            if (bmRequestType == 0x80 && usb_remote_wakeup_enabled) i = 2;
             #ifdef SUPPORT_ENDPOINT_HALT
-            if (bmRequestType == 0x82) {
-                UENUM = wIndex;
+            if (bmRequestType == 0x82 && usb_halt_endpoint(wIndex & 0x7F)) {
+                UENUM = wIndex & 0x7F;
                 if (UECONX & (1<<STALLRQ)) i = 1;
                 UENUM = 0;
             }
@@ -482,11 +1900,18 @@ ISR(USB_COM_vect)
             usb_send_in();
             return;
         }
+        // DEVICE_REMOTE_WAKEUP
+        if ((bRequest == CLEAR_FEATURE || bRequest == SET_FEATURE)
+          && bmRequestType == 0x00 && wValue == 1) {
+            usb_remote_wakeup_enabled = (bRequest == SET_FEATURE);
+            usb_send_in();
+            return;
+        }
         #ifdef SUPPORT_ENDPOINT_HALT
         if ((bRequest == CLEAR_FEATURE || bRequest == SET_FEATURE)
           && bmRequestType == 0x02 && wValue == 0) {
             i = wIndex & 0x7F;
-            if (i >= 1 && i <= MAX_ENDPOINT) {
+            if (usb_halt_endpoint(i)) {
                 usb_send_in();
                 UENUM = i;
                 if (bRequest == SET_FEATURE) {
@@ -500,15 +1925,58 @@ ISR(USB_COM_vect)
             }
         }
         #endif
-        if (wIndex == GAMEPAD_INTERFACE) {
+#ifdef USB_XINPUT
+        // Windows asks for this once it has seen string_ms_os
+        if (bRequest == MS_OS_VENDOR_CODE && bmRequestType == 0xC0
+          && wIndex == 0x0004 && usb_personality == USB_PERSONALITY_XINPUT) {
+            len = wLength;
+            if (len > sizeof(xinput_compat_id)) len = sizeof(xinput_compat_id);
+            usb_wait_in_ready();
+            for (i=0; i<len; i++) {
+                UEDATX = pgm_read_byte(&xinput_compat_id[i]);
+            }
+            usb_send_in();
+            return;
+        }
+#endif
+#ifdef GENESIS_MEGA_MOUSE
+        if (wIndex == GAMEPAD_INTERFACE + usb_interfaces()) {
+            if (bmRequestType == 0xA1 && bRequest == HID_GET_REPORT) {
+                usb_wait_in_ready();
+                mouse_write(0, 0);
+                usb_send_in();
+                return;
+            }
+            // Reports are only sent on changes, always in the same
+            // format, so idle rate and protocol settings are accepted
+            // and ignored
+            if (bmRequestType == 0x21
+              && (bRequest == HID_SET_IDLE || bRequest == HID_SET_PROTOCOL)) {
+                usb_send_in();
+                return;
+            }
+        }
+#endif
+        // The XInput interface isn't HID
+        if (wIndex - GAMEPAD_INTERFACE < usb_interfaces()
+          && usb_personality != USB_PERSONALITY_XINPUT) {
             if (bmRequestType == 0xA1) {
+                if (bRequest == HID_GET_REPORT && (wValue >> 8) == HID_REPORT_FEATURE) {
+                    usb_wait_in_ready();
+                    feature_report_write();
+                    usb_send_in();
+                    return;
+                }
                 if (bRequest == HID_GET_REPORT) {
+#ifdef GAMEPAD_MULTI_REPORT
+                    // report ID in the low byte of wValue
+                    i = (uint8_t)wValue - 1;
+#else
+                    i = wIndex - GAMEPAD_INTERFACE;
+#endif
+                    if (i >= usb_players()) i = 0;
                     usb_wait_in_ready();
-
-                    for (i=0; i<sizeof(gamepad_state_t); i++) {
-                        UEDATX = ((uint8_t*)&gamepad_state)[i];
-                    }
-
+                    usb_gamepad_write(i);
                     usb_send_in();
                     return;
                 }
@@ -526,6 +1994,14 @@ ISR(USB_COM_vect)
                 }
             }
             if (bmRequestType == 0x21) {
+                if (bRequest == HID_SET_REPORT && (wValue >> 8) == HID_REPORT_FEATURE) {
+                    if (feature_report_read(wLength)) {
+                        usb_send_in();
+                        return;
+                    }
+                    UECONX = (1<<STALLRQ) | (1<<EPEN);  // stall
+                    return;
+                }
                 if (bRequest == HID_SET_REPORT) {
                     usb_wait_receive_out();
                     usb_ack_out();
@@ -548,4 +2024,12 @@ ISR(USB_COM_vect)
     UECONX = (1<<STALLRQ) | (1<<EPEN);  // stall
 }
 
+ISR(USB_COM_vect)
+{
+    uint16_t start = sched_now();
 
+    probe_begin(PROBE_USB_ISR);
+    usb_com_handler();
+    perf_isr_done(start);
+    probe_end(PROBE_USB_ISR);
+}
@@ -48,32 +48,150 @@
 void usb_init(void);			// initialize everything
 uint8_t usb_configured(void);		// is the USB port configured
 
+// Set while the host has suspended the bus. The USB clock is stopped
+// meanwhile, so the converter should sleep until this clears.
+extern volatile uint8_t usb_suspended;
+
+// Wake the host while suspended, if it has enabled remote wakeup.
+// Returns -1 if it hasn't, or the bus isn't suspended.
+int8_t usb_remote_wakeup(void);
+
+// Gamepad endpoint poll interval (bInterval) reported to the host at
+// enumeration, in ms. Set before calling usb_init().
+extern uint8_t usb_gamepad_interval;
+
+// USB personalities. Each has its own descriptors and report format,
+// built from the same gamepad_state.
+enum usb_personality {
+    USB_PERSONALITY_GAMEPAD = 0,	// generic HID joystick
+    USB_PERSONALITY_PS3,		// PS3-style arcade stick, dpad on a hat
+    USB_PERSONALITY_KEYBOARD,		// boot-compatible NKRO keyboard, 1ms
+    USB_PERSONALITY_XINPUT,		// Xbox 360-style vendor class pad, 1ms
+    USB_NUM_PERSONALITIES
+};
+
+// The XInput personality needs a sixth endpoint, which the AT90USB162
+// (Teensy 1.0) lacks, so it is left out there and the setting falls
+// back to the generic gamepad.
+#ifndef __AVR_AT90USB162__
+#define USB_XINPUT
+#endif
+
+// Personality presented to the host. Set before calling usb_init().
+extern uint8_t usb_personality;
+
+// Number of players (one per attached pad port). Each gets its own
+// HID interface, or with GAMEPAD_MULTI_REPORT, its own report ID on
+// a single interface. The keyboard and XInput personalities only
+// report the first player.
+#ifndef GAMEPAD_PLAYERS
+#define GAMEPAD_PLAYERS 1
+#endif
+
 typedef struct {
     uint8_t     xAxis;
     uint8_t     yAxis;
 
-    // Basic buttons vary by application. Should start populating from
-    // the beginning. Common PS3 uses (e.g. using generic pad) marked in comments.
-    uint16_t   button1: 1; // Square
-    uint16_t   button2: 1; // X
-    uint16_t   button3: 1; // Circle
-    uint16_t   button4: 1; // Triangle
-    uint16_t   button5: 1; // L1
-    uint16_t   button6: 1; // R1
-    uint16_t   button7: 1; // L2
-    uint16_t   button8: 1; // R2
-    
-    // Give buttons 9/10 common names to match most uses
-    uint16_t   button_Select: 1;
-    uint16_t   button_Start: 1;
+    union {
+        // All of the button bits below, button1 in bit 0
+        uint16_t    buttons;
+
+        struct {
+            // Basic buttons vary by application. Should start populating from
+            // the beginning. Common PS3 uses (e.g. using generic pad) marked in comments.
+            uint16_t   button1: 1; // Square
+            uint16_t   button2: 1; // X
+            uint16_t   button3: 1; // Circle
+            uint16_t   button4: 1; // Triangle
+            uint16_t   button5: 1; // L1
+            uint16_t   button6: 1; // R1
+            uint16_t   button7: 1; // L2
+            uint16_t   button8: 1; // R2
+            
+            // Give buttons 9/10 common names to match most uses
+            uint16_t   button_Select: 1;
+            uint16_t   button_Start: 1;
+        };
+    };
+
+#ifdef GENESIS_XE1AP
+    // Throttle of an analog pad, 0 when released, reported as Z in the
+    // generic gamepad report
+    uint8_t     zAxis;
+#endif
 } gamepad_state_t;
 
-extern gamepad_state_t gamepad_state;
+extern gamepad_state_t gamepad_state[GAMEPAD_PLAYERS];
+
+// Bits within gamepad_state_t.buttons
+#define GAMEPAD_BUTTON(n)       (1U << ((n) - 1))
+#define GAMEPAD_BUTTON_SELECT   (1U << 8)
+#define GAMEPAD_BUTTON_START    (1U << 9)
+#define GAMEPAD_NUM_BUTTONS     10
+
+// Scheduler timer value (see scan_sched.h) when gamepad_state was
+// sampled from the pads. Set this before calling usb_gamepad_send(),
+// which publishes every player for the host's next polls without
+// waiting for them. With GAMEPAD_MULTI_REPORT, each poll gets the
+// next player due an update. Until the host configures the device,
+// it returns -1 but keeps the state for the first poll.
+extern uint16_t gamepad_sample_time;
 
 void usb_gamepad_reset_state(void);
 
 int8_t usb_gamepad_send(void);
 
+// Add Mega Mouse motion (in mouse counts, X right and Y down) and set
+// its buttons (bit 0 left, 1 right, 2 middle, 3 Start) for the mouse
+// interface. Motion adds up until the host collects it, so none is
+// lost between polls. Like usb_gamepad_send(), this never waits.
+#ifdef GENESIS_MEGA_MOUSE
+void usb_mouse_move(int16_t dx, int16_t dy, uint8_t buttons);
+#else
+#define usb_mouse_move(dx, dy, buttons)
+#endif
+
+// 11-bit number of the current USB frame
+uint16_t usb_frame_number(void);
+
+// Stream logged input events (see event_log.h) to the host over the
+// event endpoint. Call this often; it never waits.
+#ifdef EVENT_LOG
+void usb_event_send(void);
+#else
+#define usb_event_send()
+#endif
+
+// Take recorded input to play back (see playback.h) from the host's
+// playback endpoint. Call this often; it never waits.
+#ifdef PLAYBACK
+void usb_playback_receive(void);
+#else
+#define usb_playback_receive()
+#endif
+
+// Check whether the state last sent for a player is still waiting
+// for an endpoint bank, rather than on its way to the host. Players
+// the personality doesn't report are never pending.
+uint8_t usb_gamepad_pending(uint8_t player);
+
+// Bus timing, stamped with the scheduler timer. These are updated
+// from the USB interrupts, so read multi-byte values atomically.
+extern volatile uint16_t usb_sof_time;		// last start-of-frame
+extern volatile uint8_t usb_sof_frame;		// frame number of last SOF
+extern volatile uint8_t usb_poll_frame;		// frame of last gamepad poll
+extern volatile uint16_t usb_poll_offset;	// poll time after its SOF
+extern volatile uint8_t usb_poll_interval;	// frames between polls, 0 = unknown
+
+// Age of the last report collected by the host, from the time it was
+// sampled to the time the host polled it, in timer ticks.
+extern volatile uint16_t usb_gamepad_report_age;
+
+// Set when the host has changed the button remapping in settings
+// (through the remap feature report). Clear it once the change has
+// been applied and saved.
+extern volatile uint8_t usb_settings_changed;
+
 
 // Everything below this point is only intended for usb_gamepad.c
 #ifdef USB_GAMEPAD_PRIVATE_INCLUDE
@@ -103,21 +221,25 @@ int8_t usb_gamepad_send(void);
 #define MSB(n) ((n >> 8) & 255)
 
 #if defined(__AVR_AT90USB162__)
+#define HW_MAX_ENDPOINT 4
 #define HW_CONFIG()
 #define PLL_CONFIG() (PLLCSR = ((1<<PLLE)|(1<<PLLP0)))
 #define USB_CONFIG() (USBCON = (1<<USBE))
 #define USB_FREEZE() (USBCON = ((1<<USBE)|(1<<FRZCLK)))
 #elif defined(__AVR_ATmega32U4__)
+#define HW_MAX_ENDPOINT 6
 #define HW_CONFIG() (UHWCON = 0x01)
 #define PLL_CONFIG() (PLLCSR = 0x12)
 #define USB_CONFIG() (USBCON = ((1<<USBE)|(1<<OTGPADE)))
 #define USB_FREEZE() (USBCON = ((1<<USBE)|(1<<FRZCLK)))
 #elif defined(__AVR_AT90USB646__)
+#define HW_MAX_ENDPOINT 6
 #define HW_CONFIG() (UHWCON = 0x81)
 #define PLL_CONFIG() (PLLCSR = 0x1A)
 #define USB_CONFIG() (USBCON = ((1<<USBE)|(1<<OTGPADE)))
 #define USB_FREEZE() (USBCON = ((1<<USBE)|(1<<FRZCLK)))
 #elif defined(__AVR_AT90USB1286__)
+#define HW_MAX_ENDPOINT 6
 #define HW_CONFIG() (UHWCON = 0x81)
 #define PLL_CONFIG() (PLLCSR = 0x16)
 #define USB_CONFIG() (USBCON = ((1<<USBE)|(1<<OTGPADE)))
@@ -141,6 +263,10 @@ int8_t usb_gamepad_send(void);
 #define HID_SET_REPORT			9
 #define HID_SET_IDLE			10
 #define HID_SET_PROTOCOL		11
+// HID report types, in the high byte of wValue for Get/Set_Report
+#define HID_REPORT_INPUT		1
+#define HID_REPORT_OUTPUT		2
+#define HID_REPORT_FEATURE		3
 // CDC (communication class device)
 #define CDC_SET_LINE_CODING		0x20
 #define CDC_GET_LINE_CODING		0x21